@@ -0,0 +1,60 @@
+# Runs skein3_main like a user would: cmake -DSKEIN3_MAIN=<path> -P cli_test.cmake
+
+if(NOT SKEIN3_MAIN)
+    message(FATAL_ERROR "Set SKEIN3_MAIN to the skein3_main executable")
+endif()
+
+set(work "${CMAKE_CURRENT_BINARY_DIR}/skein3_cli_test")
+file(REMOVE_RECURSE "${work}")
+file(MAKE_DIRECTORY "${work}/dir")
+file(WRITE "${work}/dir/empty" "")
+file(WRITE "${work}/dir/text" "hello\n")
+file(WRITE "${work}/stdin" "")
+
+# Runs skein3_main and fails unless it exits with status expected
+function(run_cli_status expected output)
+    execute_process(COMMAND "${SKEIN3_MAIN}" ${ARGN}
+                    WORKING_DIRECTORY "${work}"
+                    INPUT_FILE "${work}/stdin"
+                    RESULT_VARIABLE result
+                    OUTPUT_VARIABLE out
+                    ERROR_VARIABLE err)
+    if(NOT result EQUAL expected)
+        message(FATAL_ERROR "skein3_main ${ARGN} exited with ${result}, not ${expected}: ${err}")
+    endif()
+    set(${output} "${out}" PARENT_SCOPE)
+endfunction()
+
+macro(run_cli output)
+    run_cli_status(0 ${output} ${ARGN})
+endmacro()
+
+# Empty files and empty input hash in both modes, like sha256sum
+foreach(mode "" "--tree")
+    run_cli(listing ${mode} dir)
+    if(NOT listing MATCHES "[0-9a-f]+  dir/empty\n" OR NOT listing MATCHES "  dir/text\n")
+        message(FATAL_ERROR "skein3_main ${mode} dir printed: ${listing}")
+    endif()
+    file(WRITE "${work}/sums" "${listing}")
+    run_cli(checked ${mode} -c sums)
+    if(NOT checked MATCHES "dir/text: OK\n")
+        message(FATAL_ERROR "skein3_main ${mode} -c sums printed: ${checked}")
+    endif()
+
+    # A modified file fails the check
+    file(WRITE "${work}/dir/text" "hello!\n")
+    run_cli_status(1 checked ${mode} -c sums)
+    if(NOT checked MATCHES "dir/text: FAILED\n" OR NOT checked MATCHES "dir/empty: OK\n")
+        message(FATAL_ERROR "skein3_main ${mode} -c sums after a change printed: ${checked}")
+    endif()
+    file(WRITE "${work}/dir/text" "hello\n")
+
+    run_cli(piped ${mode})
+    string(REGEX MATCH "^[0-9a-f]+" piped_digest "${piped}")
+    string(REGEX MATCH "([0-9a-f]+)  dir/empty" empty_line "${listing}")
+    if(NOT piped_digest STREQUAL CMAKE_MATCH_1)
+        message(FATAL_ERROR "Empty stdin and an empty file differ: ${piped}")
+    endif()
+endforeach()
+
+file(REMOVE_RECURSE "${work}")
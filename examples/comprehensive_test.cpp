@@ -7,6 +7,17 @@
 #include <chrono>
 #include <cassert>
 #include <unordered_map>
+#include <unordered_set>
+#include <type_traits>
+#include <algorithm>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <thread>
+#include <filesystem>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
 
 // Hash fonksiyonu std::vector<uint8_t> için
 struct ByteVectorHash {
@@ -29,6 +40,24 @@ public:
         testLargeData();
         testRandomData();
         testConsistency();
+        testBatchConsistency();
+        testByteViews();
+        testDigestOutputs();
+        testStreamingMatchesHash();
+        testPreparedHasher();
+        testMacContext();
+        testTreeShape();
+        testStreamingTree();
+        testTreeState();
+        testFileHashing();
+        testStreamHashing();
+        testDirectorySnapshot();
+        testCheckpoints();
+        testAppendHashing();
+        testVerifiedReads();
+        testMerkleTree();
+        testMountainRange();
+        testMerkleProofs();
     }
 
 private:
@@ -214,6 +243,1504 @@ private:
         }
     }
 
+    static void testBatchConsistency() {
+        std::cout << "\n6. Batch Consistency Test\n";
+
+        // Mixed lengths so lanes finish and get refilled at different times
+        std::vector<std::vector<uint8_t>> messages;
+        for (size_t i = 0; i < 37; ++i) {
+            std::vector<uint8_t> message((i * 97) % 1300);
+            fillRandomData(message);
+            messages.push_back(std::move(message));
+        }
+
+        for (auto size : {Skein3::HashSize::HASH_256, Skein3::HashSize::HASH_512}) {
+            Skein3::Config config;
+            config.size = size;
+
+            auto batch = Skein3::batch_hash(messages, config);
+            assert(batch.size() == messages.size());
+            for (size_t i = 0; i < messages.size(); ++i) {
+                assert(batch[i] == Skein3::hash(messages[i], config));
+            }
+        }
+
+        // Enough messages and levels to span several pool tasks
+        while (messages.size() < 3001) {
+            std::vector<uint8_t> message(messages.size() % 300);
+            fillRandomData(message);
+            messages.push_back(std::move(message));
+        }
+        auto batch = Skein3::batch_hash(messages);
+        for (size_t i = 0; i < messages.size(); ++i) {
+            assert(batch[i] == Skein3::hash(messages[i]));
+        }
+        for (size_t count : {size_t(1), size_t(2), size_t(3), size_t(7), size_t(1025), size_t(3001)}) {
+            std::vector<std::vector<uint8_t>> level(batch.begin(), batch.begin() + count);
+            while (level.size() > 1) {
+                std::vector<std::vector<uint8_t>> parents;
+                for (size_t i = 0; i < level.size(); i += 2) {
+                    std::vector<uint8_t> pair = level[i];
+                    if (i + 1 < level.size()) {
+                        pair.insert(pair.end(), level[i + 1].begin(), level[i + 1].end());
+                    }
+                    parents.push_back(Skein3::hash(pair));
+                }
+                level.swap(parents);
+            }
+            std::vector<std::vector<uint8_t>> leaves(messages.begin(), messages.begin() + count);
+            assert(Skein3::merkle_root(leaves) == level[0]);
+        }
+
+        std::cout << "Batch hashes match individual hashes\n";
+    }
+
+    static void testByteViews() {
+        std::cout << "\n7. Byte View Test\n";
+
+        const std::string text(3000, 'v');
+        const std::vector<uint8_t> bytes(text.begin(), text.end());
+        const std::string key = "secret key";
+        const std::vector<uint8_t> key_bytes(key.begin(), key.end());
+        Skein3::Config config;
+
+        // Strings, string_views and raw ranges hash like the equal vector
+        auto expected = Skein3::hash(bytes, config);
+        assert(Skein3::hash(text, config) == expected);
+        assert(Skein3::hash(std::string_view(text), config) == expected);
+        assert(Skein3::hash(bytes.data(), bytes.size(), config) == expected);
+        assert(Skein3::verifyHash(text, expected, config));
+        assert(!Skein3::verifyHash(std::string(1, 'w') + text.substr(1), expected, config));
+
+        assert(Skein3::mac(text, key, config) == Skein3::mac(bytes, key_bytes, config));
+        assert(Skein3::tree_hash(text, config) == Skein3::tree_hash(bytes, config));
+
+        // Views into one buffer instead of copied messages
+        std::vector<std::vector<uint8_t>> copies;
+        std::vector<Skein3::ByteView> views;
+        for (size_t offset = 0; offset < bytes.size(); offset += 700) {
+            size_t length = std::min<size_t>(900, bytes.size() - offset);
+            copies.emplace_back(bytes.begin() + offset, bytes.begin() + offset + length);
+            views.emplace_back(bytes.data() + offset, length);
+        }
+        assert(Skein3::batch_hash(views, config) == Skein3::batch_hash(copies, config));
+        assert(Skein3::merkle_root(views, config) == Skein3::merkle_root(copies, config));
+
+        std::cout << "Byte view overloads match vector overloads\n";
+    }
+
+    static void testDigestOutputs() {
+        std::cout << "\n8. Digest Output Test\n";
+
+        static_assert(std::is_trivially_copyable<Skein3::Digest512>::value,
+                      "digests must be trivially copyable");
+        static_assert(sizeof(Skein3::Digest256) == 32, "no padding in digests");
+
+        std::vector<uint8_t> message(5000);
+        fillRandomData(message);
+        const std::vector<uint8_t> key = {1, 2, 3, 4};
+
+        Skein3::Config config;
+        config.size = Skein3::HashSize::HASH_256;
+
+        // Fixed-size and caller-buffer outputs equal the vector results
+        Skein3::Digest256 digest;
+        Skein3::hash(message, digest, config);
+        auto expected = Skein3::hash(message, config);
+        assert(std::equal(digest.begin(), digest.end(), expected.begin()));
+        assert(Skein3::verifyHash(message, digest, config));
+
+        Skein3::Digest256 tag;
+        Skein3::mac(message, key, tag, config);
+        expected = Skein3::mac(message, key, config);
+        assert(std::equal(tag.begin(), tag.end(), expected.begin()));
+
+        std::array<uint8_t, 32> buffer;
+        Skein3::tree_hash(message, buffer.data(), config);
+        expected = Skein3::tree_hash(message, config);
+        assert(std::equal(buffer.begin(), buffer.end(), expected.begin()));
+
+        std::vector<Skein3::ByteView> leaves;
+        for (size_t offset = 0; offset < message.size(); offset += 300) {
+            leaves.emplace_back(message.data() + offset,
+                                std::min<size_t>(300, message.size() - offset));
+        }
+        Skein3::merkle_root(leaves, buffer.data(), config);
+        expected = Skein3::merkle_root(leaves, config);
+        assert(std::equal(buffer.begin(), buffer.end(), expected.begin()));
+
+        std::vector<Skein3::Digest256> digests(leaves.size());
+        Skein3::batch_hash(leaves, digests[0].data(), config);
+        auto batch = Skein3::batch_hash(leaves, config);
+        for (size_t i = 0; i < leaves.size(); ++i) {
+            assert(std::equal(digests[i].begin(), digests[i].end(), batch[i].begin()));
+        }
+
+        // Usable as set keys; distinct messages give distinct digests
+        std::unordered_set<Skein3::Digest256> unique(digests.begin(), digests.end());
+        assert(unique.size() == digests.size());
+        assert(digests[0] != digests[1] && (digests[0] < digests[1]) != (digests[1] < digests[0]));
+
+        // A digest type of the wrong size is rejected
+        bool rejected = false;
+        try {
+            Skein3::Digest512 wrong;
+            Skein3::hash(message, wrong, config);
+        } catch (const std::invalid_argument&) {
+            rejected = true;
+        }
+        assert(rejected);
+
+        std::cout << "Digest types and output buffers match vector results\n";
+    }
+
+    static void testStreamingMatchesHash() {
+        std::cout << "\n9. Streaming Test\n";
+
+        Skein3::Config config;
+        Skein3::StreamingHasher hasher(config);
+
+        // Lengths around block boundaries, fed in chunks that split blocks
+        // in every way, including the held-back last block
+        for (size_t length : {0, 1, 255, 256, 257, 512, 1000, 4099}) {
+            std::vector<uint8_t> message(length);
+            fillRandomData(message);
+            auto expected = Skein3::hash(message, config);
+
+            for (size_t chunk : {1, 7, 256, 300, 5000}) {
+                for (size_t offset = 0; offset < length; offset += chunk) {
+                    hasher.update(message.data() + offset,
+                                  std::min(chunk, length - offset));
+                }
+                assert(hasher.bytes_processed() == length);
+                // finalize() also resets, so the hasher is reused here
+                assert(hasher.finalize() == expected);
+            }
+        }
+
+        std::cout << "Streaming digests match one-shot hashes\n";
+    }
+
+    static void testPreparedHasher() {
+        std::cout << "\n10. Prepared Hasher Test\n";
+
+        // More distinct personalized configs than the IV cache holds, hashed
+        // twice so both cache hits and evictions are exercised
+        std::vector<Skein3::Config> configs;
+        for (size_t i = 0; i < 12; ++i) {
+            Skein3::Config config;
+            config.size = (i % 2) ? Skein3::HashSize::HASH_256 : Skein3::HashSize::HASH_512;
+            config.personalization = i > 0;
+            config.person_string = {static_cast<uint8_t>(i), 'p'};
+            configs.push_back(config);
+        }
+
+        std::vector<uint8_t> message(300);
+        fillRandomData(message);
+
+        std::vector<std::vector<uint8_t>> first;
+        for (const auto& config : configs) {
+            first.push_back(Skein3::hash(message, config));
+        }
+        std::unordered_set<std::vector<uint8_t>, ByteVectorHash> distinct(first.begin(), first.end());
+        assert(distinct.size() == configs.size());
+
+        for (size_t i = 0; i < configs.size(); ++i) {
+            Skein3::Hasher hasher(configs[i]);
+            assert(hasher.hash(message) == first[i]);
+            assert(Skein3::hash(message, configs[i]) == first[i]);
+        }
+
+        // Without personalization the person string is not part of the
+        // config block, so it must not select a different cached IV
+        Skein3::Config unused = configs[0];
+        unused.person_string = {9, 9, 9};
+        assert(Skein3::Hasher(unused).hash(message) == first[0]);
+
+        std::cout << "Prepared hashers match one-shot hashes\n";
+    }
+
+    static void testMacContext() {
+        std::cout << "\n11. MAC Context Test\n";
+
+        // Mixed lengths, including empty messages that only get the output block
+        std::vector<std::vector<uint8_t>> messages;
+        for (size_t i = 0; i < 29; ++i) {
+            std::vector<uint8_t> message((i * 131) % 900);
+            fillRandomData(message);
+            messages.push_back(std::move(message));
+        }
+        std::vector<Skein3::ByteView> views(messages.begin(), messages.end());
+
+        for (size_t key_size : {0, 32, 700}) {
+            std::vector<uint8_t> key(key_size);
+            fillRandomData(key);
+
+            for (auto size : {Skein3::HashSize::HASH_256, Skein3::HashSize::HASH_512}) {
+                Skein3::Config config;
+                config.size = size;
+
+                Skein3::MacContext context(key, config);
+                auto batch = context.batch_mac(views);
+                for (size_t i = 0; i < messages.size(); ++i) {
+                    auto expected = Skein3::mac(messages[i], key, config);
+                    assert(context.mac(messages[i]) == expected);
+                    assert(batch[i] == expected);
+                }
+            }
+        }
+
+        std::cout << "MAC context and batch MAC match one-shot MACs\n";
+    }
+
+    static void testTreeShape() {
+        std::cout << "\n12. Tree Shape Test\n";
+
+        // Sizes around leaf and subtree boundaries, including a partial last subtree
+        std::vector<uint8_t> data(300 * 1024 + 17);
+        fillRandomData(data);
+
+        for (size_t leaf_size : {1024, 1500}) {
+            for (size_t fan_out : {1, 2, 3, 8}) {
+                for (size_t max_height : {1, 2, 255}) {
+                    Skein3::Config config;
+                    config.mode = Skein3::HashMode::TREE;
+                    config.tree_leaf_size = leaf_size;
+                    config.tree_fan_out = fan_out;
+                    config.tree_max_height = max_height;
+
+                    for (size_t size : {size_t(1), leaf_size, leaf_size + 1,
+                                        size_t(70 * 1024), data.size()}) {
+                        Skein3::ByteView message(data.data(), size);
+                        assert(Skein3::tree_hash(message, config) ==
+                               referenceTreeHash(message, config));
+                    }
+                }
+            }
+        }
+
+        // The tree parameters are part of the digest, even for a single leaf
+        Skein3::Config config;
+        Skein3::ByteView leaf(data.data(), 100);
+        auto digest = Skein3::tree_hash(leaf, config);
+        assert(digest != Skein3::hash(leaf, config));
+        config.tree_fan_out = 4;
+        assert(Skein3::tree_hash(leaf, config) != digest);
+        config.tree_fan_out = 8;
+        config.tree_max_height = 3;
+        assert(Skein3::tree_hash(leaf, config) != digest);
+
+        // Every leaf byte and every child reaches the root: a byte near the
+        // end of any leaf of a 64-leaf tree, a non-first child of a group,
+        // the last byte of a leaf and a trailing zero all change it
+        Skein3::Config tree_config;
+        tree_config.mode = Skein3::HashMode::TREE;
+        std::vector<uint8_t> message(data.begin(), data.begin() + 64 * 1024);
+        const auto root = Skein3::tree_hash(message, tree_config);
+        for (size_t leaf_index = 0; leaf_index < 64; ++leaf_index) {
+            message[leaf_index * 1024 + 1000] ^= 1;
+            assert(Skein3::tree_hash(message, tree_config) != root);
+            message[leaf_index * 1024 + 1000] ^= 1;
+        }
+        Skein3::ByteView eight(message.data(), 8 * 1024);
+        const auto eight_root = Skein3::tree_hash(eight, tree_config);
+        message[6 * 1024] ^= 1;
+        assert(Skein3::tree_hash(eight, tree_config) != eight_root);
+        message[6 * 1024] ^= 1;
+        message[1023] ^= 1;
+        assert(Skein3::tree_hash(eight, tree_config) != eight_root);
+        message[1023] ^= 1;
+        std::vector<uint8_t> padded(message.begin(), message.begin() + 500);
+        const auto short_root = Skein3::tree_hash(padded, tree_config);
+        padded.push_back(0);
+        assert(Skein3::tree_hash(padded, tree_config) != short_root);
+        std::vector<uint8_t> children(8 * 64), node(64), changed_node(64);
+        Skein3::tree_node_hash(children, 1, node.data(), tree_config);
+        children.back() ^= 1;
+        Skein3::tree_node_hash(children, 1, changed_node.data(), tree_config);
+        assert(node != changed_node);
+
+        std::cout << "Tree hashes follow leaf size, fan-out and max height\n";
+    }
+
+    static void testStreamingTree() {
+        std::cout << "\n13. Streaming Tree Test\n";
+
+        // Several full pool runs plus a partial tail
+        std::vector<uint8_t> data(1300 * 1024 + 77);
+        fillRandomData(data);
+        std::mt19937 gen(7);
+
+        std::vector<Skein3::Config> configs(4);
+        configs[1].tree_fan_out = 3;
+        configs[1].tree_leaf_size = 1500;
+        configs[2].tree_max_height = 2;
+        configs[3].size = Skein3::HashSize::HASH_256;
+        configs[3].tree_fan_out = 2;
+
+        Skein3::StreamingTreeHasher reused(configs[0]);
+        for (const auto& config : configs) {
+            Skein3::StreamingTreeHasher hasher(config);
+            for (size_t size : {size_t(1), size_t(4096), size_t(512 * 1024), data.size()}) {
+                Skein3::ByteView message(data.data(), size);
+                auto expected = Skein3::tree_hash(message, config);
+
+                // Random update sizes, including empty ones
+                std::uniform_int_distribution<size_t> step(0, 200 * 1024);
+                for (size_t offset = 0; offset < size; ) {
+                    size_t take = std::min(step(gen), size - offset);
+                    hasher.update(data.data() + offset, take);
+                    offset += take;
+                }
+                assert(hasher.bytes_processed() == size);
+                assert(hasher.finalize() == expected);
+            }
+        }
+
+        // finalize() and reset() both start a new message
+        reused.update(data);
+        reused.reset();
+        reused.update(data.data(), 5000);
+        assert(reused.finalize() ==
+               Skein3::tree_hash(Skein3::ByteView(data.data(), 5000), configs[0]));
+
+        // Nothing fed since is an empty message, one empty leaf
+        assert(reused.finalize() ==
+               Skein3::tree_hash(std::vector<uint8_t>(), configs[0]));
+
+        // Streamed and checkpointed roots bind every leaf: a byte near the end
+        // of a non-first leaf, early and in the last group, and the last byte
+        auto streamed = [&](const std::vector<uint8_t>& message) {
+            const size_t split = 700 * 1024 + 5;
+            Skein3::StreamingTreeHasher hasher(configs[0]);
+            hasher.update(message.data(), split);
+            std::stringstream stored;
+            hasher.save(stored);
+            auto resumed = Skein3::StreamingTreeHasher::load(stored, configs[0]);
+            hasher.update(message.data() + split, message.size() - split);
+            resumed.update(message.data() + split, message.size() - split);
+            auto root = hasher.finalize();
+            assert(resumed.finalize() == root);
+            return root;
+        };
+        const auto root = streamed(data);
+        for (size_t offset : {size_t(6 * 1024 + 1000), size_t(1299 * 1024 + 1000),
+                              data.size() - 1}) {
+            data[offset] ^= 1;
+            const auto tampered = streamed(data);
+            assert(tampered != root);
+            assert(tampered == Skein3::tree_hash(data, configs[0]));
+            data[offset] ^= 1;
+        }
+
+        std::cout << "Streaming tree hashes match one-shot tree hashes\n";
+    }
+
+    static void testTreeState() {
+        std::cout << "\n14. Incremental Tree State Test\n";
+
+        std::vector<Skein3::Config> configs(3);
+        configs[1].tree_fan_out = 3;
+        configs[1].tree_leaf_size = 1500;
+        configs[2].tree_max_height = 2;
+        std::mt19937 gen(11);
+
+        for (const auto& config : configs) {
+            std::vector<uint8_t> data(200 * 1024 + 5);
+            fillRandomData(data);
+            Skein3::TreeState state(data, config);
+            assert(state.root() == Skein3::tree_hash(data, config));
+
+            // In-place edits of a few bytes, across leaf boundaries and at the ends
+            for (size_t begin : {size_t(0), size_t(1023), size_t(77777), data.size() - 3}) {
+                size_t end = std::min(begin + 5, data.size());
+                for (size_t i = begin; i < end; ++i) {
+                    data[i] ^= 0x5a;
+                }
+                state.update(data, begin, end);
+                assert(state.root() == Skein3::tree_hash(data, config));
+            }
+
+            // Appends and truncations, down to a single leaf and back
+            for (size_t size : {data.size() + 3000, size_t(150 * 1024), size_t(4096),
+                                size_t(100), size_t(9000)}) {
+                size_t old_size = data.size();
+                data.resize(size);
+                std::uniform_int_distribution<int> byte(0, 255);
+                for (size_t i = old_size; i < size; ++i) {
+                    data[i] = static_cast<uint8_t>(byte(gen));
+                }
+                state.update(data, std::min(old_size, size), size);
+                assert(state.size() == size);
+                assert(state.root() == Skein3::tree_hash(data, config));
+            }
+
+            // The node cache survives a save and load
+            std::stringstream stored;
+            state.save(stored);
+            Skein3::TreeState loaded = Skein3::TreeState::load(stored, config);
+            assert(loaded.root() == state.root());
+            data[5000] ^= 1;
+            loaded.update(data, 5000, 5001);
+            assert(loaded.root() == Skein3::tree_hash(data, config));
+
+            // A byte near the end of a non-first leaf and the last byte of a
+            // tail leaf both reach the rehashed root
+            for (size_t offset : {4 * config.tree_leaf_size + config.tree_leaf_size - 20,
+                                  data.size() - 1}) {
+                const auto before = loaded.root();
+                data[offset] ^= 1;
+                loaded.update(data, offset, offset + 1);
+                assert(loaded.root() != before);
+                assert(loaded.root() == Skein3::tree_hash(data, config));
+            }
+        }
+
+        // Damaged caches and config mismatches are refused
+        std::vector<uint8_t> data(10000, 7);
+        std::stringstream stored;
+        Skein3::TreeState(data, configs[0]).save(stored);
+        std::string bytes = stored.str();
+
+        auto refused = [](const std::string& bytes, const Skein3::Config& config) {
+            std::stringstream in(bytes);
+            try {
+                Skein3::TreeState::load(in, config);
+            } catch (const std::runtime_error&) {
+                return true;
+            }
+            return false;
+        };
+        assert(!refused(bytes, configs[0]));
+        assert(refused(bytes, configs[1]));
+        for (size_t i = 0; i < bytes.size(); ++i) {
+            std::string damaged = bytes;
+            damaged[i] ^= 1;
+            assert(refused(damaged, configs[0]));
+        }
+        assert(refused(bytes.substr(0, bytes.size() - 1), configs[0]));
+
+        std::cout << "Incremental tree updates match full tree hashes\n";
+    }
+
+    static void testFileHashing() {
+        std::cout << "\n15. File Hashing Test\n";
+
+        const std::string path = "skein3_file_hash_test.bin";
+        Skein3::Config tree_config;
+        tree_config.mode = Skein3::HashMode::TREE;
+
+        for (size_t size : {size_t(0), size_t(1000), size_t(300 * 1024 + 3)}) {
+            std::vector<uint8_t> data(size);
+            fillRandomData(data);
+            {
+                std::ofstream out(path, std::ios::binary);
+                out.write(reinterpret_cast<const char*>(data.data()),
+                          static_cast<std::streamsize>(data.size()));
+            }
+
+            assert(Skein3::hash_file(path) == Skein3::hash(data));
+            assert(Skein3::hash_file(path, tree_config) ==
+                   Skein3::tree_hash(data, tree_config));
+        }
+
+        // A byte near the end of a non-first leaf of the last group, and
+        // the last byte, reach the TREE digest of a file
+        std::vector<uint8_t> data(300 * 1024 + 3);
+        fillRandomData(data);
+        auto write_file = [&]() {
+            std::ofstream out(path, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(data.data()),
+                      static_cast<std::streamsize>(data.size()));
+        };
+        write_file();
+        const auto tree_digest = Skein3::hash_file(path, tree_config);
+        for (size_t offset : {size_t(294 * 1024 + 1000), data.size() - 1}) {
+            data[offset] ^= 1;
+            write_file();
+            const auto tampered = Skein3::hash_file(path, tree_config);
+            assert(tampered != tree_digest);
+            assert(tampered == Skein3::tree_hash(data, tree_config));
+            data[offset] ^= 1;
+        }
+        std::remove(path.c_str());
+
+        // An empty file in TREE mode is one empty leaf
+        std::vector<uint8_t> empty_leaf(Skein3::digest_size(tree_config));
+        Skein3::tree_node_hash(Skein3::ByteView(), 0, empty_leaf.data(), tree_config);
+        assert(Skein3::tree_hash(std::vector<uint8_t>(), tree_config) == empty_leaf);
+        Skein3::StreamingTreeHasher empty_stream(tree_config);
+        const auto streamed = empty_stream.finalize();
+        assert(streamed == empty_leaf);
+        (void)streamed;
+
+        bool rejected = false;
+        try {
+            Skein3::hash_file("does/not/exist");
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        assert(rejected);
+
+#ifdef __linux__
+        // procfs files cannot be mapped and report size 0, so they are read
+        std::ifstream in("/proc/self/cmdline", std::ios::binary);
+        std::vector<uint8_t> contents((std::istreambuf_iterator<char>(in)),
+                                      std::istreambuf_iterator<char>());
+        assert(Skein3::hash_file("/proc/self/cmdline") == Skein3::hash(contents));
+        assert(Skein3::hash_file("/proc/self/cmdline", tree_config) ==
+               Skein3::tree_hash(contents, tree_config));
+#endif
+
+        std::cout << "File hashes match in-memory hashes\n";
+    }
+
+    static void testStreamHashing() {
+        std::cout << "\n16. Read-Ahead Stream Hashing Test\n";
+
+        Skein3::Config tree_config;
+        tree_config.mode = Skein3::HashMode::TREE;
+
+        // Sizes below, at and across the 4 MiB read blocks
+        for (size_t size : {size_t(0), size_t(1000), size_t(4 << 20), size_t(9 << 20) + 5}) {
+            std::vector<uint8_t> data(size);
+            fillRandomData(data);
+            std::string bytes(data.begin(), data.end());
+
+            std::istringstream plain_in(bytes);
+            assert(Skein3::hash_stream(plain_in) == Skein3::hash(data));
+            std::istringstream tree_in(bytes);
+            assert(Skein3::hash_stream(tree_in, tree_config) ==
+                   Skein3::tree_hash(data, tree_config));
+        }
+
+#if defined(__unix__) || defined(__APPLE__)
+        // A pipe delivers short reads while the writer is still producing
+        auto piped = [](const std::vector<uint8_t>& data, const Skein3::Config& config) {
+            int fds[2];
+            if (pipe(fds) != 0) {
+                throw std::runtime_error("pipe failed");
+            }
+            std::thread writer([&]() {
+                for (size_t offset = 0; offset < data.size(); ) {
+                    ssize_t written = write(fds[1], data.data() + offset,
+                                            std::min<size_t>(10000, data.size() - offset));
+                    if (written <= 0) {
+                        break;
+                    }
+                    offset += static_cast<size_t>(written);
+                }
+                close(fds[1]);
+            });
+            auto digest = Skein3::hash_fd(fds[0], config);
+            writer.join();
+            close(fds[0]);
+            return digest;
+        };
+        std::vector<uint8_t> piped_data(3 << 20);
+        fillRandomData(piped_data);
+        assert(piped(piped_data, Skein3::Config()) == Skein3::hash(piped_data));
+#endif
+
+        // A byte near the end of a non-first leaf of the last group, and
+        // the last byte, reach the TREE digest of a stream
+        std::vector<uint8_t> data((5 << 20) + 5);
+        fillRandomData(data);
+        const auto tree_digest = Skein3::tree_hash(data, tree_config);
+        for (size_t offset : {size_t(5118 * 1024 + 1000), data.size() - 1}) {
+            data[offset] ^= 1;
+            std::istringstream in(std::string(data.begin(), data.end()));
+            const auto tampered = Skein3::hash_stream(in, tree_config);
+            assert(tampered != tree_digest);
+            assert(tampered == Skein3::tree_hash(data, tree_config));
+#if defined(__unix__) || defined(__APPLE__)
+            assert(piped(data, tree_config) == tampered);
+#endif
+            data[offset] ^= 1;
+        }
+
+        std::cout << "Stream hashes match in-memory hashes\n";
+    }
+
+    static void testDirectorySnapshot() {
+        std::cout << "\n17. Directory Snapshot Test\n";
+
+        namespace fs = std::filesystem;
+        const fs::path dir = "skein3_snapshot_test";
+        fs::remove_all(dir);
+        fs::create_directories(dir / "sub" / "deeper");
+
+        // Files old enough that their stat data can be trusted next scan
+        const auto old_time = fs::file_time_type::clock::now() - std::chrono::hours(1);
+        auto write_file = [&](const fs::path& path, const std::vector<uint8_t>& data, bool age) {
+            {
+                std::ofstream out(path, std::ios::binary);
+                out.write(reinterpret_cast<const char*>(data.data()),
+                          static_cast<std::streamsize>(data.size()));
+            }
+            if (age) {
+                fs::last_write_time(path, old_time);
+            }
+        };
+        std::vector<uint8_t> large(200 * 1024);
+        fillRandomData(large);
+        write_file(dir / "a.txt", {'a', 'l', 'p', 'h', 'a'}, true);
+        write_file(dir / "sub" / "b.bin", large, true);
+        write_file(dir / "sub" / "deeper" / "c", {'g', 'a', 'm', 'm', 'a'}, true);
+#if defined(__unix__) || defined(__APPLE__)
+        fs::create_symlink("a.txt", dir / "link");
+#endif
+
+        // Root over (path length, path, size, digest) leaves, by hand
+        auto expected_root = [&](const Skein3::DirectorySnapshot& snapshot,
+                                 const Skein3::Config& config) {
+            std::vector<std::vector<uint8_t>> leaves;
+            for (size_t i = 0; i < snapshot.entries().size(); ++i) {
+                const auto& entry = snapshot.entries()[i];
+                std::vector<uint8_t> leaf;
+                for (uint64_t value : {uint64_t(entry.path.size())}) {
+                    for (int b = 0; b < 8; ++b) leaf.push_back(uint8_t(value >> (8 * b)));
+                }
+                leaf.insert(leaf.end(), entry.path.begin(), entry.path.end());
+                for (int b = 0; b < 8; ++b) leaf.push_back(uint8_t(entry.size >> (8 * b)));
+                leaf.insert(leaf.end(), snapshot.digest(i),
+                            snapshot.digest(i) + Skein3::digest_size(config));
+                leaves.push_back(leaf);
+            }
+            Skein3::Config root_config = config;
+            root_config.mode = Skein3::HashMode::STANDARD;
+            std::vector<Skein3::ByteView> views(leaves.begin(), leaves.end());
+            return Skein3::MerkleTree(views, root_config).root();
+        };
+
+        Skein3::Config tree_config;
+        tree_config.mode = Skein3::HashMode::TREE;
+        for (const auto& config : {Skein3::Config(), tree_config}) {
+            Skein3::DirectorySnapshot snapshot(config);
+            snapshot.scan(dir.string());
+            assert(snapshot.files_hashed() == 3);
+            assert(snapshot.entries().size() == 3);
+            assert(snapshot.entries()[0].path == "a.txt");
+            assert(snapshot.entries()[1].path == "sub/b.bin");
+            assert(snapshot.entries()[2].path == "sub/deeper/c");
+            for (size_t i = 0; i < 3; ++i) {
+                auto digest = Skein3::hash_file((dir / snapshot.entries()[i].path).string(), config);
+                assert(std::equal(digest.begin(), digest.end(), snapshot.digest(i)));
+            }
+            assert(snapshot.root() == expected_root(snapshot, config));
+        }
+
+        Skein3::DirectorySnapshot snapshot;
+        snapshot.scan(dir.string());
+        const auto first_root = snapshot.root();
+
+        // Unchanged files are not read again, also after a save and load
+        snapshot.scan(dir.string());
+        assert(snapshot.files_hashed() == 0);
+        assert(snapshot.root() == first_root);
+        std::stringstream stored;
+        snapshot.save(stored);
+        auto loaded = Skein3::DirectorySnapshot::load(stored);
+        loaded.scan(dir.string());
+        assert(loaded.files_hashed() == 0);
+        assert(loaded.root() == first_root);
+
+        // Same size and mtime, new content: the ctime change gives it away
+        write_file(dir / "a.txt", {'o', 'm', 'e', 'g', 'a'}, true);
+        snapshot.scan(dir.string());
+        assert(snapshot.files_hashed() == 1);
+        assert(snapshot.root() != first_root);
+        assert(snapshot.root() == expected_root(snapshot, Skein3::Config()));
+        auto changed = Skein3::hash_file((dir / "a.txt").string());
+        assert(std::equal(changed.begin(), changed.end(), snapshot.digest(0)));
+
+        // Every entry reaches the root, the odd-indexed one included
+        const auto edited_root = snapshot.root();
+        large[large.size() / 2] ^= 1;
+        write_file(dir / "sub" / "b.bin", large, true);
+        snapshot.scan(dir.string());
+        assert(snapshot.files_hashed() == 1);
+        assert(snapshot.entries()[1].path == "sub/b.bin");
+        assert(snapshot.root() != edited_root);
+        assert(snapshot.root() == expected_root(snapshot, Skein3::Config()));
+
+        // A file written just now is re-hashed until its mtime is safely old
+        write_file(dir / "new", {'n', 'e', 'w'}, false);
+        snapshot.scan(dir.string());
+        assert(snapshot.files_hashed() == 1);
+        snapshot.scan(dir.string());
+        assert(snapshot.files_hashed() == 1);
+        assert(snapshot.entries().size() == 4);
+
+        fs::remove(dir / "a.txt");
+        snapshot.scan(dir.string());
+        assert(snapshot.entries().size() == 3);
+        assert(snapshot.entries()[0].path == "new");
+
+        // Damaged indexes and config mismatches are refused
+        std::stringstream saved;
+        snapshot.save(saved);
+        const std::string bytes = saved.str();
+        auto refused = [](const std::string& bytes, const Skein3::Config& config) {
+            std::stringstream in(bytes);
+            try {
+                Skein3::DirectorySnapshot::load(in, config);
+            } catch (const std::runtime_error&) {
+                return true;
+            }
+            return false;
+        };
+        Skein3::Config small_config;
+        small_config.size = Skein3::HashSize::HASH_256;
+        assert(!refused(bytes, Skein3::Config()));
+        assert(refused(bytes, small_config));
+        assert(refused(bytes, tree_config));
+        std::string damaged = bytes;
+        damaged[damaged.size() / 2] ^= 1;
+        assert(refused(damaged, Skein3::Config()));
+
+        // An empty file hashes in TREE mode too
+        write_file(dir / "empty", {}, true);
+        Skein3::DirectorySnapshot tree_snapshot(tree_config);
+        tree_snapshot.scan(dir.string());
+        assert(tree_snapshot.failures().empty());
+        assert(tree_snapshot.entries().size() == 4);
+        assert(tree_snapshot.entries()[0].path == "empty");
+        const auto empty_digest = Skein3::hash_file((dir / "empty").string(), tree_config);
+        assert(std::equal(empty_digest.begin(), empty_digest.end(), tree_snapshot.digest(0)));
+
+        // In TREE mode too a byte near the end of a non-first leaf reaches the root
+        std::vector<uint8_t> leaves(large.begin(), large.begin() + 8 * 1024);
+        write_file(dir / "empty", leaves, true);
+        tree_snapshot.scan(dir.string());
+        const auto tree_root = tree_snapshot.root();
+        leaves[6 * 1024 + 1000] ^= 1;
+        write_file(dir / "empty", leaves, true);
+        tree_snapshot.scan(dir.string());
+        assert(tree_snapshot.root() != tree_root);
+        write_file(dir / "empty", {}, true);
+
+#if defined(__unix__) || defined(__APPLE__)
+        // Unreadable files and directories are reported, not fatal. Skipped
+        // where permissions do not apply, as for root.
+        fs::permissions(dir / "new", fs::perms::none);
+        fs::permissions(dir / "sub" / "deeper", fs::perms::none);
+        if (::access((dir / "new").c_str(), R_OK) != 0 &&
+            ::access((dir / "sub" / "deeper").c_str(), R_OK) != 0) {
+            snapshot.scan(dir.string());
+            assert(snapshot.failures().size() == 2);
+            assert(snapshot.failures()[0].path == "new");
+            assert(snapshot.failures()[1].path == "sub/deeper");
+            assert(!snapshot.failures()[0].error.empty());
+            assert(snapshot.entries().size() == 2);
+            assert(snapshot.entries()[0].path == "empty");
+            assert(snapshot.entries()[1].path == "sub/b.bin");
+            assert(snapshot.root() == expected_root(snapshot, Skein3::Config()));
+        }
+        fs::permissions(dir / "new", fs::perms::owner_read | fs::perms::owner_write);
+        fs::permissions(dir / "sub" / "deeper", fs::perms::owner_all);
+#endif
+
+        fs::remove_all(dir);
+        std::cout << "Snapshots re-hash only changed files\n";
+    }
+
+    static void testCheckpoints() {
+        std::cout << "\n18. Midstate Checkpoint Test\n";
+
+        // Split the input at a checkpoint, resume from the saved bytes
+        std::vector<uint8_t> data((3 << 20) + 1000);
+        fillRandomData(data);
+        for (size_t size : {size_t(0), size_t(100), size_t(256), size_t(257), size_t(5000)}) {
+            for (size_t split : {size_t(0), size / 2, size_t(256), size}) {
+                if (split > size) {
+                    continue;
+                }
+                Skein3::StreamingHasher hasher;
+                hasher.update(data.data(), split);
+                std::stringstream stored;
+                hasher.save(stored);
+                assert(stored.str().size() <= 624);
+
+                auto resumed = Skein3::StreamingHasher::load(stored);
+                assert(resumed.bytes_processed() == split);
+                resumed.update(data.data() + split, size - split);
+                assert(resumed.finalize() == Skein3::hash(Skein3::ByteView(data.data(), size)));
+            }
+        }
+
+        // Tree checkpoints before, inside and across the parallel runs
+        Skein3::Config tree_config;
+        tree_config.mode = Skein3::HashMode::TREE;
+        const auto expected = Skein3::tree_hash(data, tree_config);
+        for (size_t split : {size_t(500), size_t(1024), size_t(1 << 20) + 1500,
+                             size_t(2 << 20), size_t(3 << 20) + 7}) {
+            Skein3::StreamingTreeHasher hasher(tree_config);
+            hasher.update(data.data(), split);
+            std::stringstream stored;
+            hasher.save(stored);
+            assert(stored.str().size() < 4096);
+
+            // Saving does not change the digest of the running hasher
+            hasher.update(data.data() + split, data.size() - split);
+            assert(hasher.finalize() == expected);
+
+            // A resumed hasher can itself be checkpointed again
+            auto resumed = Skein3::StreamingTreeHasher::load(stored, tree_config);
+            const size_t second = std::min(data.size(), split + (1 << 20) + 3);
+            resumed.update(data.data() + split, second - split);
+            std::stringstream again;
+            resumed.save(again);
+            auto last = Skein3::StreamingTreeHasher::load(again, tree_config);
+            last.update(data.data() + second, data.size() - second);
+            assert(last.bytes_processed() == data.size());
+            assert(last.finalize() == expected);
+        }
+
+        // Damaged checkpoints, other configs and the other hasher are refused
+        Skein3::StreamingHasher hasher;
+        hasher.update(data.data(), 1000);
+        std::stringstream stored;
+        hasher.save(stored);
+        const std::string bytes = stored.str();
+        auto refused = [](const std::string& bytes, bool tree, const Skein3::Config& config) {
+            std::stringstream in(bytes);
+            try {
+                if (tree) {
+                    Skein3::StreamingTreeHasher::load(in, config);
+                } else {
+                    Skein3::StreamingHasher::load(in, config);
+                }
+            } catch (const std::runtime_error&) {
+                return true;
+            }
+            return false;
+        };
+        Skein3::Config small_config;
+        small_config.size = Skein3::HashSize::HASH_256;
+        assert(!refused(bytes, false, Skein3::Config()));
+        assert(refused(bytes, false, small_config));
+        assert(refused(bytes, true, tree_config));
+        for (size_t i = 0; i < bytes.size(); ++i) {
+            std::string damaged = bytes;
+            damaged[i] ^= 1;
+            assert(refused(damaged, false, Skein3::Config()));
+        }
+        assert(refused(bytes.substr(0, bytes.size() - 1), false, Skein3::Config()));
+
+        std::cout << "Resumed hashers match uninterrupted hashes\n";
+    }
+
+    static void testAppendHashing() {
+        std::cout << "\n19. Append-Only File Hashing Test\n";
+
+        const std::string path = "skein3_append_test.log";
+        const std::string state_path = path + ".sk3state";
+        const std::string tree_state_path = path + ".tree";
+        Skein3::Config tree_config;
+        tree_config.mode = Skein3::HashMode::TREE;
+        std::vector<uint8_t> log(100 * 1024);
+        fillRandomData(log);
+        auto write_log = [&](std::ios::openmode mode, size_t begin, size_t end) {
+            std::ofstream out(path, std::ios::binary | mode);
+            out.write(reinterpret_cast<const char*>(log.data() + begin),
+                      static_cast<std::streamsize>(end - begin));
+        };
+        using Status = Skein3::AppendHasher::Status;
+        const Skein3::AppendHasher hasher;
+        const Skein3::AppendHasher tree_hasher(tree_config);
+        std::remove(state_path.c_str());
+        std::remove(tree_state_path.c_str());
+
+        write_log(std::ios::trunc, 0, 70 * 1024);
+        auto result = hasher.hash(path);
+        assert(result.status == Status::FULL);
+        assert(result.bytes_hashed == 70 * 1024 && result.size == 70 * 1024);
+        assert(result.digest == Skein3::hash_file(path));
+
+        // Appends read only the new tail, for both hash kinds
+        assert(tree_hasher.hash(path, tree_state_path).status == Status::FULL);
+        for (size_t end : {size_t(70 * 1024 + 1), size_t(70 * 1024 + 1), size_t(100 * 1024)}) {
+            const uint64_t before = result.size;
+            write_log(std::ios::app, static_cast<size_t>(before), end);
+            result = hasher.hash(path);
+            assert(result.status == Status::APPENDED);
+            assert(result.bytes_hashed == end - before && result.size == end);
+            assert(result.digest == Skein3::hash_file(path));
+
+            auto tree_result = tree_hasher.hash(path, tree_state_path);
+            assert(tree_result.status == Status::APPENDED);
+            assert(tree_result.digest == Skein3::hash_file(path, tree_config));
+        }
+
+        // Appended data reaches the TREE digest: a byte near the end of a
+        // non-first leaf of the last group
+        const auto tree_digest = Skein3::hash_file(path, tree_config);
+        log[78 * 1024 + 1000] ^= 1;
+        write_log(std::ios::trunc, 0, 70 * 1024);
+        tree_hasher.hash(path, tree_state_path);
+        write_log(std::ios::app, 70 * 1024, 100 * 1024);
+        auto tampered = tree_hasher.hash(path, tree_state_path);
+        assert(tampered.status == Status::APPENDED);
+        assert(tampered.digest != tree_digest);
+        assert(tampered.digest == Skein3::hash_file(path, tree_config));
+        log[78 * 1024 + 1000] ^= 1;
+        write_log(std::ios::trunc, 0, 100 * 1024);
+
+        // A state saved with another config is not used
+        result = tree_hasher.hash(path, state_path);
+        assert(result.status == Status::FULL);
+        assert(result.digest == Skein3::hash_file(path, tree_config));
+
+        // Truncated, and truncated then regrown past the saved offset
+        write_log(std::ios::trunc, 0, 50 * 1024);
+        result = hasher.hash(path);
+        assert(result.status == Status::REWRITTEN);
+        assert(result.bytes_hashed == 50 * 1024);
+        assert(result.digest == Skein3::hash_file(path));
+        write_log(std::ios::trunc, 1, 60 * 1024);
+        result = hasher.hash(path);
+        assert(result.status == Status::REWRITTEN);
+        assert(result.digest == Skein3::hash_file(path));
+        write_log(std::ios::app, 0, 10);
+        assert(hasher.hash(path).status == Status::APPENDED);
+
+        // A damaged state file is ignored
+        {
+            std::fstream state(state_path, std::ios::in | std::ios::out | std::ios::binary);
+            state.seekp(20);
+            state.put('\x55');
+        }
+        result = hasher.hash(path);
+        assert(result.status == Status::FULL);
+        assert(result.digest == Skein3::hash_file(path));
+
+        // An empty log in TREE mode, then its first bytes
+        std::remove(tree_state_path.c_str());
+        write_log(std::ios::trunc, 0, 0);
+        result = tree_hasher.hash(path, tree_state_path);
+        assert(result.status == Status::FULL && result.size == 0);
+        assert(result.digest == Skein3::tree_hash(std::vector<uint8_t>(), tree_config));
+        write_log(std::ios::app, 0, 3000);
+        result = tree_hasher.hash(path, tree_state_path);
+        assert(result.status == Status::APPENDED && result.bytes_hashed == 3000);
+        assert(result.digest == Skein3::hash_file(path, tree_config));
+
+        std::remove(path.c_str());
+        std::remove(state_path.c_str());
+        std::remove(tree_state_path.c_str());
+        std::cout << "Appended files hash only their new bytes\n";
+    }
+
+    static void testVerifiedReads() {
+        std::cout << "\n20. Verified Range And Stream Reads Test\n";
+
+        Skein3::Config config;
+        config.mode = Skein3::HashMode::TREE;
+        std::vector<uint8_t> data(300 * 1024 + 123);
+        fillRandomData(data);
+        std::stringstream outboard;
+        const auto root = Skein3::VerifiedReader::write_outboard(data, outboard, config);
+        assert(root == Skein3::tree_hash(data, config));
+        const std::string encoded = outboard.str();
+        // 301 leaf digests, 38 + 5 parents and the root's one child group
+        assert(encoded.size() == 88 + (301 + 38 + 5) * 64);
+
+        auto slice = [&](std::pair<uint64_t, uint64_t> range) {
+            return Skein3::ByteView(data.data() + range.first,
+                                    static_cast<size_t>(range.second - range.first));
+        };
+        Skein3::VerifiedReader reader(root, data.size(), outboard, config);
+        for (auto range : {std::make_pair<uint64_t, uint64_t>(5000, 9000),
+                           std::make_pair<uint64_t, uint64_t>(data.size() - 10, data.size()),
+                           std::make_pair<uint64_t, uint64_t>(0, 1),
+                           std::make_pair<uint64_t, uint64_t>(0, data.size())}) {
+            auto aligned = reader.leaf_range(range.first, range.second);
+            assert(aligned.first <= range.first && aligned.second >= range.second);
+            assert(reader.verify(aligned.first, slice(aligned)));
+        }
+        bool rejected = false;
+        try {
+            reader.verify(100, slice({100, 2048}));
+        } catch (const std::invalid_argument&) {
+            rejected = true;
+        }
+        assert(rejected);
+
+        // A changed leaf fails, and the reader keeps working afterwards
+        std::vector<uint8_t> bad(data.begin() + 150 * 1024, data.begin() + 152 * 1024);
+        bad[1024] ^= 1;
+        assert(!reader.verify(150 * 1024, bad));
+        assert(reader.verify(150 * 1024, slice({150 * 1024, 152 * 1024})));
+
+        // Damaged outboard nodes or a wrong root are caught
+        std::string damaged = encoded;
+        damaged[88] ^= 1;
+        std::stringstream damaged_outboard(damaged);
+        Skein3::VerifiedReader damaged_reader(root, data.size(), damaged_outboard, config);
+        assert(!damaged_reader.verify(0, slice({0, 1024})));
+        std::stringstream truncated_outboard(encoded.substr(0, 88 + 300 * 64));
+        Skein3::VerifiedReader truncated_reader(root, data.size(), truncated_outboard, config);
+        assert(!truncated_reader.verify(data.size() - 123, slice({data.size() - 123, data.size()})));
+        auto wrong_root = root;
+        wrong_root[0] ^= 1;
+        Skein3::VerifiedReader wrong_reader(wrong_root, data.size(), outboard, config);
+        assert(!wrong_reader.verify(0, slice({0, 1024})));
+        rejected = false;
+        try {
+            Skein3::VerifiedReader wrong_size(root, data.size() + 1, outboard, config);
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        assert(rejected);
+
+        // Every byte of a leaf and every digest of a group is bound: a forged
+        // second leaf fails even with its own digest spliced into the
+        // outboard, and so does a change in the last block of a leaf
+        std::vector<uint8_t> forged = data;
+        forged[1024 + 700] ^= 1;
+        std::stringstream forged_outboard;
+        Skein3::VerifiedReader::write_outboard(forged, forged_outboard, config);
+        std::string spliced = encoded;
+        spliced.replace(88 + 64, 64, forged_outboard.str().substr(88 + 64, 64));
+        std::stringstream spliced_outboard(spliced);
+        Skein3::VerifiedReader spliced_reader(root, data.size(), spliced_outboard, config);
+        assert(!spliced_reader.verify(1024, Skein3::ByteView(forged.data() + 1024, 1024)));
+        assert(!spliced_reader.verify(0, slice({0, 1024})));
+        std::vector<uint8_t> tail(data.begin() + 3 * 1024, data.begin() + 4 * 1024);
+        tail[1000] ^= 1;
+        assert(!reader.verify(3 * 1024, tail));
+
+        // Streams are checked leaf by leaf as they arrive
+        Skein3::VerifiedReader stream(root, data.size(), outboard, config);
+        for (size_t offset = 0; offset < data.size(); offset += 777) {
+            const size_t take = std::min<size_t>(777, data.size() - offset);
+            assert(stream.update(Skein3::ByteView(data.data() + offset, take)));
+            assert(stream.verified() <= offset + take && offset + take - stream.verified() < 1024);
+        }
+        assert(stream.finish() && stream.verified() == data.size());
+
+        std::vector<uint8_t> tampered = data;
+        tampered[100000] ^= 0x80;
+        Skein3::VerifiedReader tampered_stream(root, data.size(), outboard, config);
+        assert(!tampered_stream.update(tampered));
+        assert(tampered_stream.verified() <= 100000 && !tampered_stream.finish());
+        Skein3::VerifiedReader short_stream(root, data.size(), outboard, config);
+        assert(short_stream.update(slice({0, data.size() - 1})) && !short_stream.finish());
+        Skein3::VerifiedReader long_stream(root, data.size(), outboard, config);
+        assert(long_stream.update(data) && !long_stream.update(slice({0, 1})));
+
+        // A single leaf has no outboard nodes; the top level may be wide
+        std::vector<uint8_t> small(data.begin(), data.begin() + 500);
+        std::stringstream small_outboard;
+        const auto small_root =
+            Skein3::VerifiedReader::write_outboard(small, small_outboard, config);
+        assert(small_outboard.str().size() == 88);
+        Skein3::VerifiedReader small_reader(small_root, small.size(), small_outboard, config);
+        assert(small_reader.verify(0, small));
+        small.push_back(0);
+        std::stringstream padded_outboard;
+        const auto padded_root =
+            Skein3::VerifiedReader::write_outboard(small, padded_outboard, config);
+        assert(padded_root != small_root);
+        Skein3::Config flat = config;
+        flat.tree_max_height = 1;
+        std::stringstream flat_outboard;
+        const auto flat_root = Skein3::VerifiedReader::write_outboard(data, flat_outboard, flat);
+        Skein3::VerifiedReader flat_reader(flat_root, data.size(), flat_outboard, flat);
+        assert(flat_reader.verify(200 * 1024, slice({200 * 1024, 201 * 1024})));
+        std::string flat_spliced = flat_outboard.str();
+        flat_spliced.replace(88 + 200 * 64, 64, encoded.substr(88, 64));
+        std::stringstream flat_spliced_outboard(flat_spliced);
+        Skein3::VerifiedReader flat_spliced_reader(flat_root, data.size(),
+                                                   flat_spliced_outboard, flat);
+        assert(!flat_spliced_reader.verify(200 * 1024, slice({200 * 1024, 201 * 1024})));
+        std::cout << "Ranges and streams verify against the root\n";
+    }
+
+    static void testMerkleTree() {
+        std::cout << "\n21. Mutable Merkle Tree Test\n";
+
+        std::vector<std::vector<uint8_t>> leaves;
+        for (size_t i = 0; i < 3001; ++i) {
+            std::vector<uint8_t> leaf(i % 200);
+            fillRandomData(leaf);
+            leaves.push_back(std::move(leaf));
+        }
+        auto views = [&]() {
+            return std::vector<Skein3::ByteView>(leaves.begin(), leaves.end());
+        };
+        std::mt19937 rng(21);
+        auto random_leaf = [&]() {
+            std::vector<uint8_t> leaf(1 + rng() % 150);
+            fillRandomData(leaf);
+            return leaf;
+        };
+
+        Skein3::MerkleTree tree(views());
+        assert(tree.size() == leaves.size());
+        bool rebuilt = matchesRebuild(tree, leaves);
+        assert(rebuilt);
+
+        // Scattered and dense batches, repeated indices and leaf 0
+        for (size_t changes : {size_t(1), size_t(37), size_t(1500)}) {
+            for (size_t i = 0; i < changes; ++i) {
+                const size_t index = i == 0 ? 0 : rng() % leaves.size();
+                leaves[index] = random_leaf();
+                tree.update(index, leaves[index]);
+            }
+            rebuilt = matchesRebuild(tree, leaves);
+            assert(rebuilt);
+        }
+
+        // Appends change the pairing of the old last nodes
+        Skein3::MerkleTree grown;
+        for (size_t i = 0; i < 70; ++i) {
+            grown.append(leaves[i]);
+            if (i % 7 == 0 || i < 10) {
+                std::vector<std::vector<uint8_t>> prefix(leaves.begin(), leaves.begin() + i + 1);
+                rebuilt = matchesRebuild(grown, prefix);
+                assert(rebuilt);
+            }
+        }
+        const size_t old_size = leaves.size();
+        for (size_t i = 70; i < old_size; ++i) {
+            tree.append(leaves[i]);
+            leaves.push_back(leaves[i]);
+        }
+        leaves[5] = random_leaf();
+        tree.update(5, leaves[5]);
+        tree.update(leaves.size() - 1, leaves[0]);
+        leaves.back() = leaves[0];
+        rebuilt = matchesRebuild(tree, leaves);
+        assert(rebuilt);
+        (void)rebuilt;
+
+        bool rejected = false;
+        try {
+            tree.update(leaves.size(), leaves[0]);
+        } catch (const std::out_of_range&) {
+            rejected = true;
+        }
+        assert(rejected);
+        rejected = false;
+        try {
+            Skein3::MerkleTree().root();
+        } catch (const std::invalid_argument&) {
+            rejected = true;
+        }
+        assert(rejected);
+        std::cout << "Updated and grown trees match a full rebuild\n";
+    }
+
+    static void testMountainRange() {
+        std::cout << "\n22. Merkle Mountain Range Test\n";
+
+        using Range = Skein3::MerkleMountainRange;
+        std::vector<std::vector<uint8_t>> leaves;
+        for (size_t i = 0; i < 40; ++i) {
+            std::vector<uint8_t> leaf(1 + (i * 37) % 90);
+            fillRandomData(leaf);
+            leaves.push_back(std::move(leaf));
+        }
+        const std::vector<Skein3::ByteView> views(leaves.begin(), leaves.end());
+
+        // One by one, keeping every root, and in uneven batches
+        Range single;
+        std::vector<std::vector<uint8_t>> roots;
+        for (size_t i = 0; i < leaves.size(); ++i) {
+            const uint64_t index = single.append(leaves[i]);
+            assert(index == i);
+            (void)index;
+            roots.push_back(single.root());
+        }
+        Range batched;
+        for (size_t begin = 0; begin < views.size(); begin += 7) {
+            batched.append(std::vector<Skein3::ByteView>(
+                views.begin() + begin, views.begin() + std::min(begin + 7, views.size())));
+        }
+        assert(batched.size() == leaves.size() && batched.root() == roots.back());
+        Skein3::Digest<512> root_digest;
+        batched.root(root_digest);
+        assert(std::equal(root_digest.begin(), root_digest.end(), roots.back().begin()));
+
+        // Every leaf of the last two sizes, every pair of sizes
+        for (uint64_t index = 0; index < leaves.size(); ++index) {
+            auto proof = single.inclusion_proof(index);
+            assert(Range::verify_inclusion(roots.back(), leaves.size(), index,
+                                           leaves[index], proof));
+            assert(!Range::verify_inclusion(roots.back(), leaves.size(), index,
+                                            leaves[(index + 1) % leaves.size()], proof));
+            if (!proof.empty()) {
+                proof.back() ^= 1;
+                assert(!Range::verify_inclusion(roots.back(), leaves.size(), index,
+                                                leaves[index], proof));
+            }
+        }
+        for (uint64_t old_size = 1; old_size <= leaves.size(); ++old_size) {
+            auto proof = single.consistency_proof(old_size);
+            assert(Range::verify_consistency(roots[old_size - 1], old_size,
+                                             roots.back(), leaves.size(), proof));
+            assert(!Range::verify_consistency(roots[old_size - 1], old_size,
+                                              roots[leaves.size() - 2], leaves.size(), proof));
+            proof.back() ^= 1;
+            assert(!Range::verify_consistency(roots[old_size - 1], old_size,
+                                              roots.back(), leaves.size(), proof));
+        }
+
+        // Every leaf byte is bound: a changed last byte or an extra zero
+        // byte fails, also in the final block of a leaf longer than a digest
+        for (uint64_t index : {uint64_t(2), uint64_t(7)}) {
+            assert(leaves[index].size() > 64);
+            const auto proof = single.inclusion_proof(index);
+            auto forged = leaves[index];
+            forged.back() ^= 1;
+            assert(!Range::verify_inclusion(roots.back(), leaves.size(), index, forged, proof));
+            forged.back() ^= 1;
+            forged.push_back(0);
+            assert(!Range::verify_inclusion(roots.back(), leaves.size(), index, forged, proof));
+        }
+        auto tail_leaves = leaves;
+        tail_leaves[7].back() ^= 1;
+        Range tail_range;
+        tail_range.append(std::vector<Skein3::ByteView>(tail_leaves.begin(), tail_leaves.end()));
+        assert(tail_range.root() != roots.back());
+
+        // Both children of a node are bound, not only the left one
+        Range changed;
+        changed.append(std::vector<Skein3::ByteView>(views.begin(), views.end() - 1));
+        changed.append(leaves.front());
+        assert(changed.root() != roots.back());
+
+        // Nodes in a file: reopen, continue, and drop a torn batch
+        const std::string path = "skein3_mmr_test.nodes";
+        std::remove(path.c_str());
+        {
+            Range stored(path);
+            stored.append(std::vector<Skein3::ByteView>(views.begin(), views.begin() + 25));
+        }
+        {
+            std::ofstream torn(path, std::ios::binary | std::ios::app);
+            torn.write("partial node", 12);
+        }
+        Range reopened(path);
+        assert(reopened.size() == 25 && reopened.root() == roots[24]);
+        reopened.append(std::vector<Skein3::ByteView>(views.begin() + 25, views.end()));
+        assert(reopened.root() == roots.back());
+        assert(reopened.inclusion_proof(3) == single.inclusion_proof(3));
+        assert(reopened.consistency_proof(25) == single.consistency_proof(25));
+
+        bool rejected = false;
+        try {
+            Skein3::Config other;
+            other.size = Skein3::HashSize::HASH_256;
+            Range wrong(path, other);
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        assert(rejected);
+        std::remove(path.c_str());
+        std::cout << "Mountain range proofs verify and survive a reopen\n";
+    }
+
+    static void testMerkleProofs() {
+        std::cout << "\n23. Merkle Proofs Test\n";
+
+        using Tree = Skein3::MerkleTree;
+        std::vector<std::vector<uint8_t>> leaves;
+        for (size_t i = 0; i < 1001; ++i) {
+            std::vector<uint8_t> leaf(1 + (i * 53) % 200);
+            fillRandomData(leaf);
+            leaves.push_back(std::move(leaf));
+        }
+        const std::vector<Skein3::ByteView> views(leaves.begin(), leaves.end());
+        const size_t count = leaves.size();
+
+        Tree tree(views);
+        bool pending = false;
+        try {
+            tree.proof(0);
+        } catch (const std::runtime_error&) {
+            pending = true;
+        }
+        assert(pending);
+        const auto root = tree.root();
+        assert(root == referenceMerkleLevels(leaves).back()[0]);
+        const size_t hash_size = root.size();
+
+        // Every single proof, then all of them as one batch
+        std::vector<size_t> indices;
+        std::vector<std::vector<uint8_t>> proofs;
+        for (size_t index = 0; index < count; ++index) {
+            proofs.push_back(tree.proof(index));
+            indices.push_back(index);
+            assert(Tree::verify_proof(root, count, index, leaves[index], proofs.back()));
+            assert(tree.multiproof({index}) == proofs.back());
+        }
+        const std::vector<Skein3::ByteView> proof_views(proofs.begin(), proofs.end());
+        assert(Tree::verify_proofs(root, count, indices, views, proof_views));
+
+        // Out of order and repeated leaves in a batch
+        std::vector<size_t> some{999, 3, 1000, 3, 0, 512};
+        std::vector<Skein3::ByteView> some_leaves;
+        std::vector<Skein3::ByteView> some_proofs;
+        for (size_t index : some) {
+            some_leaves.push_back(leaves[index]);
+            some_proofs.push_back(proofs[index]);
+        }
+        assert(Tree::verify_proofs(root, count, some, some_leaves, some_proofs));
+
+        // A multiproof shares the upper levels of its paths
+        std::vector<size_t> subset;
+        std::vector<Skein3::ByteView> subset_leaves;
+        size_t separate = 0;
+        for (size_t index = 0; index < count; index += 1 + index % 9) {
+            subset.push_back(index);
+            subset_leaves.push_back(leaves[index]);
+            separate += proofs[index].size();
+        }
+        auto multiproof = tree.multiproof(subset);
+        assert(multiproof.size() < separate / 4);
+        assert(Tree::verify_multiproof(root, count, subset, subset_leaves, multiproof));
+
+        // Every leaf byte and every sibling reaches the root, right-hand
+        // ones included: a forged leaf, a leaf with its last byte changed
+        // or a proof with any digest changed fails at every index
+        const std::vector<uint8_t> attacker{'a', 't', 't', 'a', 'c', 'k', 'e', 'r'};
+        for (size_t index = 0; index < count; index += 1 + index % 6) {
+            assert(!Tree::verify_proof(root, count, index, attacker, proofs[index]));
+            auto tail = leaves[index];
+            tail.back() ^= 1;
+            assert(!Tree::verify_proof(root, count, index, tail, proofs[index]));
+            for (size_t byte = hash_size - 1; byte < proofs[index].size(); byte += hash_size) {
+                auto bad = proofs[index];
+                bad[byte] ^= 1;
+                assert(!Tree::verify_proof(root, count, index, leaves[index], bad));
+            }
+        }
+        assert(!Tree::verify_proofs(root, count, {1}, {attacker}, {proofs[1]}));
+        auto right_sibling = proofs[0];
+        right_sibling[hash_size - 1] ^= 1;
+        assert(!Tree::verify_proofs(root, count, {0}, {views[0]}, {right_sibling}));
+        std::vector<Skein3::ByteView> wrong_leaves = views;
+        wrong_leaves[999] = attacker;
+        assert(!Tree::verify_proofs(root, count, indices, wrong_leaves, proof_views));
+        std::vector<Skein3::ByteView> bad_views = proof_views;
+        bad_views[0] = right_sibling;
+        assert(!Tree::verify_proofs(root, count, indices, views, bad_views));
+
+        for (size_t byte = hash_size - 1; byte < multiproof.size(); byte += 7 * hash_size) {
+            auto bad = multiproof;
+            bad[byte] ^= 1;
+            assert(!Tree::verify_multiproof(root, count, subset, subset_leaves, bad));
+        }
+        subset_leaves[1] = attacker;
+        assert(!Tree::verify_multiproof(root, count, subset, subset_leaves, multiproof));
+        assert(!Tree::verify_multiproof(root, count, subset, views, multiproof));
+
+        // Proofs follow updates once root() has applied them
+        leaves[0] = leaves[2];
+        tree.update(0, leaves[0]);
+        const auto updated = tree.root();
+        assert(Tree::verify_proof(updated, count, 0, leaves[0], tree.proof(0)));
+        assert(!Tree::verify_proof(root, count, 0, leaves[0], tree.proof(0)));
+
+        Tree one({views[7]});
+        const auto one_root = one.root();
+        assert(one.proof(0).empty());
+        assert(Tree::verify_proof(one_root, 1, 0, leaves[7], {}));
+        std::cout << "Single proofs, batches and multiproofs verify\n";
+    }
+
+    // A MerkleTree node: the data zero padded to whole blocks, then a block
+    // of the tag and the data length, so every byte reaches the digest
+    static std::vector<uint8_t> boundHash(Skein3::ByteView data, size_t height) {
+        const size_t block = Threefish3::BLOCK_SIZE;
+        std::vector<uint8_t> message((data.size + block - 1) / block * block + 16);
+        std::copy(data.data, data.data + data.size, message.begin());
+        const uint64_t words[2] = {Skein3::MerkleTree::FORMAT_VERSION << 32 | height, data.size};
+        for (size_t i = 0; i < 16; ++i) {
+            message[message.size() - 16 + i] = static_cast<uint8_t>(words[i / 8] >> (8 * (i % 8)));
+        }
+        return Skein3::hash(message);
+    }
+
+    // Applies the queued changes, then checks the root and every proof, so
+    // every node below the root that has a sibling, against a rebuild
+    static bool matchesRebuild(Skein3::MerkleTree& tree,
+                               const std::vector<std::vector<uint8_t>>& leaves) {
+        const auto levels = referenceMerkleLevels(leaves);
+        if (tree.root() != levels.back()[0]) {
+            return false;
+        }
+        for (size_t index = 0; index < leaves.size(); ++index) {
+            std::vector<uint8_t> expected;
+            size_t node = index;
+            for (size_t height = 0; height + 1 < levels.size(); ++height, node /= 2) {
+                if ((node ^ 1) < levels[height].size()) {
+                    const auto& sibling = levels[height][node ^ 1];
+                    expected.insert(expected.end(), sibling.begin(), sibling.end());
+                }
+            }
+            if (tree.proof(index) != expected) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Every level of a MerkleTree over leaves, the root last
+    static std::vector<std::vector<std::vector<uint8_t>>> referenceMerkleLevels(
+            const std::vector<std::vector<uint8_t>>& leaves) {
+        std::vector<std::vector<std::vector<uint8_t>>> levels(1);
+        for (const auto& leaf : leaves) {
+            levels[0].push_back(boundHash(leaf, 0));
+        }
+        for (size_t height = 1; levels.back().size() > 1; ++height) {
+            const auto& children = levels.back();
+            std::vector<std::vector<uint8_t>> parents;
+            for (size_t i = 0; i < children.size(); i += 2) {
+                std::vector<uint8_t> pair = children[i];
+                if (i + 1 < children.size()) {
+                    pair.insert(pair.end(), children[i + 1].begin(), children[i + 1].end());
+                }
+                parents.push_back(boundHash(pair, height));
+            }
+            levels.push_back(std::move(parents));
+        }
+        return levels;
+    }
+
+    // Leaves of tree_leaf_size bytes, parents over up to tree_fan_out
+    // children, and everything left goes under one node at tree_max_height
+    static std::vector<uint8_t> referenceTreeHash(Skein3::ByteView message,
+                                                  const Skein3::Config& config) {
+        const size_t fan_out = std::max<size_t>(2, config.tree_fan_out);
+        const size_t hash_size = Skein3::digest_size(config);
+
+        std::vector<std::vector<uint8_t>> level;
+        for (size_t offset = 0; offset < message.size; offset += config.tree_leaf_size) {
+            size_t size = std::min(config.tree_leaf_size, message.size - offset);
+            level.emplace_back(hash_size);
+            Skein3::tree_node_hash(Skein3::ByteView(message.data + offset, size), 0,
+                                   level.back().data(), config);
+        }
+        for (size_t height = 1; level.size() > 1; ++height) {
+            size_t group = height == config.tree_max_height ? level.size() : fan_out;
+            std::vector<std::vector<uint8_t>> parents;
+            for (size_t i = 0; i < level.size(); i += group) {
+                std::vector<uint8_t> children;
+                for (size_t j = i; j < std::min(i + group, level.size()); ++j) {
+                    children.insert(children.end(), level[j].begin(), level[j].end());
+                }
+                parents.emplace_back(hash_size);
+                Skein3::tree_node_hash(children, height, parents.back().data(), config);
+            }
+            level.swap(parents);
+        }
+        return level[0];
+    }
+
     static void fillRandomData(std::vector<uint8_t>& data) {
         std::random_device rd;
         std::mt19937 gen(rd());
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <iomanip>
 #include <chrono>
+#include <algorithm>
 
 void testPerformance() {
     // Test data sizes
@@ -35,7 +36,62 @@ void testPerformance() {
     PerformanceMetrics::generateReport();
 }
 
+// p50/p99 latency of one call, in nanoseconds
+template <typename F>
+void reportLatency(const std::string& label, F&& hash_once) {
+    const size_t samples = 20000;
+    std::vector<double> latencies(samples);
+    for (size_t i = 0; i < 1000; ++i) {
+        hash_once();
+    }
+    for (auto& latency : latencies) {
+        auto start = std::chrono::steady_clock::now();
+        hash_once();
+        auto end = std::chrono::steady_clock::now();
+        latency = std::chrono::duration<double, std::nano>(end - start).count();
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::left << std::setw(34) << label << std::right << std::fixed
+              << std::setprecision(0)
+              << " p50 " << std::setw(6) << latencies[samples / 2] << " ns"
+              << "  p99 " << std::setw(6) << latencies[samples * 99 / 100] << " ns\n";
+}
+
+void testShortMessageLatency() {
+    std::cout << "Short message latency (" << Threefish3::backend_name(
+        Threefish3::active_backend()) << " backend):\n";
+
+    Skein3::Config config;
+    Skein3::Hasher hasher(config);
+    Skein3::Digest512 digest;
+
+    for (size_t size : {0, 32, 64, 255}) {
+        std::vector<uint8_t> message(size, 'x');
+        std::string suffix = " (" + std::to_string(size) + " bytes)";
+
+        reportLatency("hash() -> vector" + suffix, [&]() {
+            auto result = Skein3::hash(message, config);
+            (void)result;
+        });
+        reportLatency("hash() -> Digest512" + suffix, [&]() {
+            Skein3::hash(message, digest, config);
+        });
+        reportLatency("Hasher -> Digest512" + suffix, [&]() {
+            hasher.hash(message, digest);
+        });
+
+        // General block loop, for comparison with the single-block path
+        reportLatency("StreamingHasher" + suffix, [&]() {
+            Skein3::StreamingHasher stream(config);
+            stream.update(message);
+            stream.finalize(digest.data());
+        });
+    }
+    std::cout << "\n";
+}
+
 int main() {
+    testShortMessageLatency();
     testPerformance();
     return 0;
 } 
\ No newline at end of file
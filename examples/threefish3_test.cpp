@@ -0,0 +1,146 @@
+#include "threefish3.h"
+#include <iostream>
+#include <cassert>
+#include <random>
+#include <vector>
+
+namespace {
+    std::array<uint64_t, Threefish3::NUM_WORDS> randomWords(std::mt19937_64& gen) {
+        std::array<uint64_t, Threefish3::NUM_WORDS> words;
+        for (auto& word : words) {
+            word = gen();
+        }
+        return words;
+    }
+}
+
+void testContextMatchesCipher() {
+    std::mt19937_64 gen(42);
+    std::array<uint64_t, 3> tweak = {1, 2, 3};
+
+    Threefish3::Context context;
+    for (int i = 0; i < 64; i++) {
+        auto key = randomWords(gen);
+        auto plaintext = randomWords(gen);
+
+        // Reference: a freshly constructed cipher per block
+        Threefish3 cipher(key, tweak, Threefish3::SecurityMode::STANDARD);
+        std::array<uint64_t, Threefish3::NUM_WORDS> expected;
+        cipher.encrypt(plaintext, expected);
+
+        // Same context rekeyed in place
+        context.rekey(key);
+        std::array<uint64_t, Threefish3::NUM_WORDS> actual;
+        context.encrypt(plaintext, actual);
+        assert(actual == expected);
+
+        // UBI step overwrites the chaining value with E(key, block) ^ block
+        auto chain = key;
+        context.ubi(chain, reinterpret_cast<const uint8_t*>(plaintext.data()));
+        for (size_t w = 0; w < Threefish3::NUM_WORDS; w++) {
+            assert(chain[w] == (expected[w] ^ plaintext[w]));
+        }
+    }
+
+    std::cout << "Keyed context matches per-block cipher\n";
+}
+
+void testMultiBufferMatchesContext() {
+    std::mt19937_64 gen(7);
+
+    // Cover full groups, partial groups and the single-chain fallback
+    for (size_t count = 1; count <= 3 * Threefish3::MAX_LANES; count++) {
+        std::vector<std::array<uint64_t, Threefish3::NUM_WORDS>> chains(count);
+        std::vector<std::array<uint64_t, Threefish3::NUM_WORDS>> blocks(count);
+        std::vector<std::array<uint64_t, Threefish3::NUM_WORDS>*> chain_ptrs;
+        std::vector<const uint8_t*> block_ptrs;
+        for (size_t i = 0; i < count; i++) {
+            chains[i] = randomWords(gen);
+            blocks[i] = randomWords(gen);
+            chain_ptrs.push_back(&chains[i]);
+            block_ptrs.push_back(reinterpret_cast<const uint8_t*>(blocks[i].data()));
+        }
+        auto expected = chains;
+
+        Threefish3::ubi_multi(chain_ptrs.data(), block_ptrs.data(), count);
+
+        Threefish3::Context context;
+        for (size_t i = 0; i < count; i++) {
+            context.ubi(expected[i], block_ptrs[i]);
+            assert(chains[i] == expected[i]);
+        }
+    }
+
+    std::cout << "Multi-buffer UBI (" << Threefish3::multi_buffer_lanes()
+              << " lanes) matches single-chain UBI\n";
+}
+
+void testBackendsAgree() {
+    const Threefish3::Backend original = Threefish3::active_backend();
+    const std::array<Threefish3::Backend, 3> backends = {
+        Threefish3::Backend::SCALAR,
+        Threefish3::Backend::AVX2,
+        Threefish3::Backend::AVX512
+    };
+
+    std::mt19937_64 gen(1234);
+    std::array<uint64_t, 3> tweak = {gen(), gen(), gen()};
+    const size_t count = 2 * Threefish3::MAX_LANES + 3;
+    std::vector<std::array<uint64_t, Threefish3::NUM_WORDS>> keys(count), blocks(count);
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = randomWords(gen);
+        blocks[i] = randomWords(gen);
+    }
+
+    // Results of every operation under one backend
+    auto run = [&]() {
+        std::vector<std::array<uint64_t, Threefish3::NUM_WORDS>> results;
+        std::vector<std::array<uint64_t, Threefish3::NUM_WORDS>*> chain_ptrs;
+        std::vector<const uint8_t*> block_ptrs;
+        auto chains = keys;
+        for (size_t i = 0; i < count; i++) {
+            Threefish3 cipher(keys[i], tweak, Threefish3::SecurityMode::STANDARD);
+            std::array<uint64_t, Threefish3::NUM_WORDS> encrypted, decrypted;
+            cipher.encrypt(blocks[i], encrypted);
+            cipher.decrypt(blocks[i], decrypted);
+            results.push_back(encrypted);
+            results.push_back(decrypted);
+            chain_ptrs.push_back(&chains[i]);
+            block_ptrs.push_back(reinterpret_cast<const uint8_t*>(blocks[i].data()));
+        }
+        Threefish3::ubi_multi(chain_ptrs.data(), block_ptrs.data(), count);
+        results.insert(results.end(), chains.begin(), chains.end());
+        return results;
+    };
+
+    Threefish3::set_backend(Threefish3::Backend::SCALAR);
+    const auto reference = run();
+
+    for (auto backend : backends) {
+        if (!Threefish3::backend_supported(backend)) {
+            std::cout << "Backend " << Threefish3::backend_name(backend)
+                      << " not supported, skipped\n";
+            continue;
+        }
+        Threefish3::set_backend(backend);
+        assert(Threefish3::active_backend() == backend);
+        assert(run() == reference);
+        std::cout << "Backend " << Threefish3::backend_name(backend)
+                  << " matches scalar\n";
+    }
+
+    Threefish3::set_backend(original);
+}
+
+int main() {
+    try {
+        std::cout << "Starting Threefish3 tests...\n";
+        testContextMatchesCipher();
+        testMultiBufferMatchesContext();
+        testBackendsAgree();
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+}
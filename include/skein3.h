@@ -7,6 +7,13 @@
 #include <cstdint>
 #include <memory>
 #include <cstring>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <stdexcept>
+#include <deque>
+#include <algorithm>
+#include <iosfwd>
 
 // Project includes
 #include "threefish3.h"
@@ -69,6 +76,7 @@ public:
         OptimizationMode opt_mode;
         size_t tree_leaf_size;
         size_t tree_fan_out;
+        size_t tree_max_height;
         bool personalization;
         std::vector<uint8_t> person_string;
         
@@ -92,6 +100,7 @@ public:
             , opt_mode(OptimizationMode::STANDARD)
             , tree_leaf_size(1024)
             , tree_fan_out(8)
+            , tree_max_height(255)
             , personalization(false)
             , batch_processing(false)
             , batch_size(1024)
@@ -105,6 +114,65 @@ public:
         {}
     };
 
+    /**
+     * @brief Non-owning view of a byte range
+     *
+     * Accepted by every hashing entry point so data held in strings,
+     * mapped files or network buffers is read in place instead of being
+     * copied into a std::vector first. The viewed bytes must outlive the
+     * call.
+     */
+    struct ByteView {
+        const uint8_t* data;
+        size_t size;
+
+        ByteView() : data(nullptr), size(0) {}
+        ByteView(const uint8_t* bytes, size_t length) : data(bytes), size(length) {}
+        ByteView(const std::vector<uint8_t>& bytes)
+            : data(bytes.data()), size(bytes.size()) {}
+        ByteView(std::string_view bytes)
+            : data(reinterpret_cast<const uint8_t*>(bytes.data())), size(bytes.size()) {}
+        ByteView(const std::string& bytes)
+            : ByteView(std::string_view(bytes)) {}
+    };
+
+    /**
+     * @brief Fixed-size digest value
+     *
+     * Trivially copyable, so digests can be stored, compared and used as
+     * map keys without a heap allocation per hash.
+     */
+    template <size_t Bits>
+    struct Digest {
+        static_assert(Bits % 8 == 0, "digest size must be whole bytes");
+        static constexpr size_t SIZE = Bits / 8;
+
+        std::array<uint8_t, SIZE> bytes;
+
+        uint8_t* data() { return bytes.data(); }
+        const uint8_t* data() const { return bytes.data(); }
+        static constexpr size_t size() { return SIZE; }
+        const uint8_t* begin() const { return bytes.data(); }
+        const uint8_t* end() const { return bytes.data() + SIZE; }
+
+        bool operator==(const Digest& other) const { return bytes == other.bytes; }
+        bool operator!=(const Digest& other) const { return bytes != other.bytes; }
+        bool operator<(const Digest& other) const { return bytes < other.bytes; }
+
+        operator ByteView() const { return ByteView(bytes.data(), SIZE); }
+    };
+
+    using Digest256 = Digest<256>;
+    using Digest512 = Digest<512>;
+    using Digest1024 = Digest<1024>;
+
+    /**
+     * @brief Digest length in bytes for a configuration
+     */
+    static size_t digest_size(const Config& config) {
+        return static_cast<size_t>(config.size) / 8;
+    }
+
     /**
      * @brief Compute hash of input message
      * @param message Input data to be hashed
@@ -115,6 +183,28 @@ public:
         const std::vector<uint8_t>& message,
         const Config& config = Config()
     );
+
+    static std::vector<uint8_t> hash(ByteView message, const Config& config = Config());
+
+    static std::vector<uint8_t> hash(const uint8_t* data, size_t size,
+                                     const Config& config = Config());
+
+    /**
+     * @brief Hash into a caller-provided buffer without allocating
+     * @param message Input data to be hashed
+     * @param digest Output, digest_size(config) bytes
+     * @param config Hash configuration options
+     */
+    static void hash(ByteView message, uint8_t* digest, const Config& config = Config());
+
+    /**
+     * @brief Hash into a fixed-size digest; config.size must equal Bits
+     */
+    template <size_t Bits>
+    static void hash(ByteView message, Digest<Bits>& digest, const Config& config = Config()) {
+        check_digest_size(config, Bits);
+        hash(message, digest.data(), config);
+    }
     
     /**
      * @brief Compute MAC (Message Authentication Code)
@@ -126,45 +216,146 @@ public:
     static std::vector<uint8_t> mac(const std::vector<uint8_t>& message,
                                   const std::vector<uint8_t>& key,
                                   const Config& config = Config());
+
+    static std::vector<uint8_t> mac(ByteView message, ByteView key,
+                                    const Config& config = Config());
+
+    static void mac(ByteView message, ByteView key, uint8_t* digest,
+                    const Config& config = Config());
+
+    template <size_t Bits>
+    static void mac(ByteView message, ByteView key, Digest<Bits>& digest,
+                    const Config& config = Config()) {
+        check_digest_size(config, Bits);
+        mac(message, key, digest.data(), config);
+    }
     
+    // Version 1 trees hashed nodes like plain messages, which left the
+    // end of each node's last block out of the digest
+    static constexpr uint64_t TREE_FORMAT_VERSION = 2;
+
     /**
      * @brief Parallel tree-based hashing
+     *
+     * The tree depends only on config.tree_leaf_size (minimum 1024),
+     * config.tree_fan_out (minimum 2) and config.tree_max_height, which
+     * are part of every node's config block. The digest is the same for
+     * any number of worker threads. An empty message is one empty leaf.
+     * Every message byte and every child digest reaches the root; see
+     * tree_node_hash().
+     *
      * @param message Input message
      * @param config Tree configuration
      * @return Hash value as byte vector
      */
     static std::vector<uint8_t> tree_hash(const std::vector<uint8_t>& message,
                                         const Config& config = Config());
+
+    static std::vector<uint8_t> tree_hash(ByteView message, const Config& config = Config());
+
+    static void tree_hash(ByteView message, uint8_t* digest, const Config& config = Config());
+
+    /**
+     * @brief Hash one node of the tree_hash tree
+     *
+     * Height 0 is a leaf over up to tree_leaf_size message bytes. A node at
+     * height h > 0 hashes the digests of its children back to back: up to
+     * tree_fan_out of them, or all remaining nodes at tree_max_height.
+     * The node data is zero padded to whole blocks and followed by a block
+     * of TREE_FORMAT_VERSION << 32 | h and the data length, both
+     * little-endian u64, hashed from the chaining value of height h.
+     */
+    static void tree_node_hash(ByteView data, size_t height, uint8_t* digest,
+                               const Config& config = Config());
+
+    /**
+     * @brief Hash a file without copying it onto the heap
+     *
+     * Regular files are memory-mapped and hashed in place: with
+     * HashMode::TREE through tree_hash() on the worker pool, otherwise
+     * through hash(). Files that cannot be mapped are read in large
+     * aligned blocks. The digest equals hashing the file contents directly.
+     *
+     * @throws std::runtime_error if the file cannot be opened or read
+     */
+    static std::vector<uint8_t> hash_file(const std::string& path,
+                                          const Config& config = Config());
+
+    static void hash_file(const std::string& path, uint8_t* digest,
+                          const Config& config = Config());
+
+    /**
+     * @brief Hash everything read from a stream until end of input
+     *
+     * An I/O thread reads ahead into a ring of buffers while the calling
+     * thread hashes the ones already filled, so waiting on the source
+     * overlaps with hashing. With HashMode::TREE the digest is the
+     * tree_hash() of the data, otherwise its hash().
+     *
+     * @throws std::runtime_error if reading fails
+     */
+    static std::vector<uint8_t> hash_stream(std::istream& in, const Config& config = Config());
+
+    static void hash_stream(std::istream& in, uint8_t* digest, const Config& config = Config());
+
+    /**
+     * @brief hash_stream() for a POSIX file descriptor such as a pipe or socket
+     *
+     * Reads until end of file; the descriptor is left open.
+     */
+    static std::vector<uint8_t> hash_fd(int fd, const Config& config = Config());
+
+    static void hash_fd(int fd, uint8_t* digest, const Config& config = Config());
     
+    /**
+     * @brief Hasher prepared once from a Config for hashing many messages
+     */
+    class Hasher;
+
+    /**
+     * @brief MAC context that absorbs its key once for many messages
+     */
+    class MacContext;
+
     /**
      * @brief Streaming hash processor for continuous data
      */
-    class StreamingHasher {
-    public:
-        /**
-         * @brief Initialize streaming hasher
-         * @param config Hash configuration
-         */
-        StreamingHasher(const Config& config = Config());
+    class StreamingHasher;
 
-        /**
-         * @brief Process new chunk of data
-         * @param data Input data chunk
-         */
-        void update(const std::vector<uint8_t>& data);
+    /**
+     * @brief Streaming counterpart of tree_hash for input of unknown length
+     */
+    class StreamingTreeHasher;
 
-        /**
-         * @brief Complete hash computation
-         * @return Final hash value
-         */
-        std::vector<uint8_t> finalize();
+    /**
+     * @brief Stored tree_hash nodes of a mutable object, for re-hashing edits
+     */
+    class TreeState;
 
-    private:
-        Config config_;
-        std::vector<uint8_t> buffer_;
-        std::array<uint64_t, Threefish3::NUM_WORDS> state_;
-        size_t total_bytes_;
-    };
+    /**
+     * @brief Manifest of a directory tree that re-hashes only changed files
+     */
+    class DirectorySnapshot;
+
+    /**
+     * @brief Hashes growing files by resuming from a midstate saved next to them
+     */
+    class AppendHasher;
+
+    /**
+     * @brief Verifies ranges and streams of untrusted data against a tree_hash root
+     */
+    class VerifiedReader;
+
+    /**
+     * @brief Merkle tree with proofs over a leaf list that changes in place and grows
+     */
+    class MerkleTree;
+
+    /**
+     * @brief Append-only Merkle Mountain Range with inclusion and consistency proofs
+     */
+    class MerkleMountainRange;
 
     // New methods
     static std::vector<std::vector<uint8_t>> batch_hash(
@@ -172,11 +363,48 @@ public:
         const Config& config = Config()
     );
 
+    static std::vector<std::vector<uint8_t>> batch_hash(
+        const std::vector<ByteView>& messages,
+        const Config& config = Config()
+    );
+
+    /**
+     * @brief Batch hash into one flat buffer
+     *
+     * Runs of consecutive messages are hashed on the worker pool, each
+     * through the multi-buffer engine.
+     * @param digests Output, messages.size() * digest_size(config) bytes,
+     *                digest i at offset i * digest_size(config)
+     */
+    static void batch_hash(const std::vector<ByteView>& messages,
+                           uint8_t* digests,
+                           const Config& config = Config());
+
     static std::vector<uint8_t> merkle_root(
         const std::vector<std::vector<uint8_t>>& transactions,
         const Config& config = Config()
     );
 
+    static std::vector<uint8_t> merkle_root(
+        const std::vector<ByteView>& transactions,
+        const Config& config = Config()
+    );
+
+    static void merkle_root(const std::vector<ByteView>& transactions,
+                            uint8_t* root,
+                            const Config& config = Config());
+
+    /**
+     * @brief Merkle root over leaves that are already digests
+     *
+     * leaves holds count digests of digest_size(config) bytes back to back;
+     * merkle_root() is this over the digests of its transactions. Each level
+     * is hashed in pairs on the worker pool, and the root does not depend on
+     * the number of threads.
+     */
+    static void merkle_root_from_digests(const uint8_t* leaves, size_t count, uint8_t* root,
+                                         const Config& config = Config());
+
     static bool verify_zero_knowledge(
         const std::vector<uint8_t>& proof,
         const std::vector<uint8_t>& public_input,
@@ -252,6 +480,9 @@ public:
         const Config& config = Config()
     );
 
+    static bool verifyHash(ByteView message, ByteView hash,
+                           const Config& config = Config());
+
     static void secureCleanup();
 
 private:
@@ -277,20 +508,202 @@ private:
     }
     
     /**
-     * @brief Unique Block Iteration function
-     * Core compression function using Threefish
+     * @brief Validate license and configuration for a hash call
      */
-    static void UBI(std::array<uint64_t, Threefish3::NUM_WORDS>& G,
-                   const std::array<uint64_t, Threefish3::NUM_WORDS>& block,
-                   const std::array<uint64_t, 3>& tweak,
-                   Threefish3::SecurityMode sec_mode);
-    
+    static void check_hash_config(const Config& config);
+
+    /**
+     * @brief Throw std::invalid_argument unless config.size is bits
+     */
+    static void check_digest_size(const Config& config, size_t bits);
+
+    /**
+     * @brief Cipher security mode for a hash size
+     */
+    static Threefish3::SecurityMode security_mode(const Config& config);
+
+    /**
+     * @brief Chaining value after the config block, where every message starts
+     *
+     * Served from a small per-thread LRU keyed by the config block, so
+     * repeated calls with the same settings skip the config encryption.
+     */
+    static std::array<uint64_t, Threefish3::NUM_WORDS> initial_chain(const Config& config);
+
+    /**
+     * @brief Chaining value for a tree node at the given height
+     */
+    static std::array<uint64_t, Threefish3::NUM_WORDS> tree_chain(const Config& config,
+                                                                  size_t height);
+
+    /**
+     * @brief Chaining value after an arbitrary config block, through the LRU
+     */
+    static std::array<uint64_t, Threefish3::NUM_WORDS> initial_chain(
+        const std::array<uint64_t, Threefish3::NUM_WORDS>& cfg_block);
+
+    /**
+     * @brief Hash one message starting from a prepared chaining value
+     */
+    static void hash_message(const std::array<uint64_t, Threefish3::NUM_WORDS>& iv,
+                             Threefish3::SecurityMode sec_mode,
+                             ByteView message,
+                             uint8_t* digest,
+                             size_t hash_size);
+
+    /**
+     * @brief Hash independent messages through the multi-buffer engine
+     *
+     * Produces the same digests as hash() on each message. Messages are
+     * assigned to cipher lanes and a lane is refilled with the next
+     * message as soon as its current one finishes.
+     *
+     * @param messages Start of each message
+     * @param sizes Length of each message in bytes
+     * @param count Number of messages
+     * @param config Hash configuration shared by all messages
+     * @param digests Output, count digests of config.size / 8 bytes back to back
+     */
+    static void hash_many(const uint8_t* const* messages,
+                          const size_t* sizes,
+                          size_t count,
+                          const Config& config,
+                          uint8_t* digests);
+
+    /**
+     * @brief Multi-buffer core of hash_many and MacContext::batch_mac
+     *
+     * Every message starts from iv. With output_transform each message
+     * also gets the MAC output block after its last message block; with
+     * tag it gets the ubi_bound() trailer block instead.
+     */
+    static void ubi_many(const std::array<uint64_t, Threefish3::NUM_WORDS>& iv,
+                         const uint8_t* const* messages,
+                         const size_t* sizes,
+                         size_t count,
+                         bool output_transform,
+                         size_t hash_size,
+                         uint8_t* digests,
+                         const uint64_t* tag = nullptr);
+
+    /**
+     * @brief Hash messages so that every byte of each reaches its digest
+     *
+     * Only the first hash_size bytes of a message's final block reach the
+     * digest, and trailing zeros in a block are not told apart. Each
+     * message is therefore zero padded to whole blocks and followed by a
+     * final block of just tag and the message length, both little-endian
+     * u64. The digest equals hash() of that padded message when iv is
+     * initial_chain(). Runs on the calling thread; the padding and the
+     * trailer go to the cipher lanes directly, so nothing is copied.
+     */
+    static void ubi_bound(const std::array<uint64_t, Threefish3::NUM_WORDS>& iv,
+                          const uint8_t* const* messages,
+                          const size_t* sizes,
+                          size_t count,
+                          uint64_t tag,
+                          size_t hash_size,
+                          uint8_t* digests);
+
+    /**
+     * @brief ubi_bound() on the worker pool, in runs cut as for hash_many()
+     */
+    static void hash_bound(const std::array<uint64_t, Threefish3::NUM_WORDS>& iv,
+                           const uint8_t* const* messages,
+                           const size_t* sizes,
+                           size_t count,
+                           uint64_t tag,
+                           size_t hash_size,
+                           uint8_t* digests);
+
+    /**
+     * @brief Hash consecutive pieces of one buffer on the calling thread
+     *
+     * Piece i is data[i * piece, min((i + 1) * piece, size)) and its digest
+     * goes to digests + i * hash_size. With tag each piece is hashed as by
+     * ubi_bound(); tree leaves and tree levels, where a piece is a run of
+     * sibling digests, are hashed that way.
+     */
+    static void hash_pieces(const std::array<uint64_t, Threefish3::NUM_WORDS>& iv,
+                            const uint8_t* data,
+                            size_t size,
+                            size_t piece,
+                            size_t hash_size,
+                            uint8_t* digests,
+                            const uint64_t* tag = nullptr);
+
+    /**
+     * @brief Validated tree parameters with the chaining value of each height
+     */
+    struct TreeShape {
+        Config config;
+        size_t leaf_size;
+        size_t fan_out;
+        size_t max_height;
+        size_t hash_size;
+        std::vector<std::array<uint64_t, Threefish3::NUM_WORDS>> chains;
+
+        explicit TreeShape(const Config& tree_config);
+
+        /**
+         * @brief Make chains cover every height up to and including height
+         */
+        void extend(size_t height);
+
+        /**
+         * @brief ubi_bound() tag of the nodes at height
+         */
+        static uint64_t tag(size_t height) { return TREE_FORMAT_VERSION << 32 | height; }
+
+        /**
+         * @brief Children of a node at height over a level of count nodes
+         */
+        size_t group_size(size_t height, size_t count) const {
+            return height == max_height ? count : std::min(fan_out, count);
+        }
+
+        /**
+         * @brief Height of the root of a tree over num_leaves leaves
+         */
+        size_t root_height(size_t num_leaves) const;
+
+        /**
+         * @brief Largest subtree height, at most max_height - 2, whose
+         *        leaves fit in max_bytes (0 if one leaf does not)
+         */
+        size_t subtree_height(size_t max_bytes) const;
+    };
+
+    /**
+     * @brief Hash one tree node at height from its chaining value
+     */
+    static void tree_node(const std::array<uint64_t, Threefish3::NUM_WORDS>& chain,
+                          size_t height, ByteView data, size_t hash_size, uint8_t* digest);
+
+    /**
+     * @brief Hash one tree level into its parents at height
+     */
+    static void tree_level(const TreeShape& shape, size_t height,
+                           const uint8_t* nodes, size_t count, uint8_t* parents);
+
+    /**
+     * @brief Hash the leaves of data and reduce them levels times
+     *
+     * With levels == SIZE_MAX reduces until one node is left. Runs on the
+     * calling thread; shape.chains must already cover the heights used.
+     */
+    static void tree_reduce(const TreeShape& shape, const uint8_t* data, size_t size,
+                            size_t levels, uint8_t* root);
+
     /**
      * @brief Process configuration block
      * Initialize hash state with configuration
      */
     static void process_config_block(std::array<uint64_t, Threefish3::NUM_WORDS>& state,
                                    const Config& config);
+
+    static void process_config_block(std::array<uint64_t, Threefish3::NUM_WORDS>& state,
+                                   const std::array<uint64_t, Threefish3::NUM_WORDS>& cfg_block);
     
     /**
      * @brief Process message block
@@ -320,6 +733,7 @@ private:
         uint64_t domain;
         bool is_first;
         bool is_final;
+        Threefish3::Context cipher;
         
         BlockContext() : bytes_processed(0), domain(DOMAIN_MSG), 
                         is_first(true), is_final(false) {
@@ -342,4 +756,773 @@ private:
     );
 };
 
+/**
+ * @brief Hasher prepared once from a Config
+ *
+ * Validates the config and license, resolves the security mode and runs
+ * the config block at construction. Each hash then only processes the
+ * message blocks, which for short messages halves the cipher work. A
+ * prepared hasher is immutable and can be shared between threads.
+ */
+class Skein3::Hasher {
+public:
+    explicit Hasher(const Config& config = Config());
+
+    std::vector<uint8_t> hash(ByteView message) const;
+
+    /**
+     * @brief Hash into digest_size() bytes at digest
+     */
+    void hash(ByteView message, uint8_t* digest) const;
+
+    template <size_t Bits>
+    void hash(ByteView message, Digest<Bits>& digest) const {
+        if (Bits / 8 != hash_size_) {
+            throw std::invalid_argument("Digest size does not match config.size");
+        }
+        hash(message, digest.data());
+    }
+
+    size_t digest_size() const { return hash_size_; }
+
+private:
+    std::array<uint64_t, Threefish3::NUM_WORDS> iv_;
+    Threefish3::SecurityMode sec_mode_;
+    size_t hash_size_;
+};
+
+/**
+ * @brief MAC context keyed once
+ *
+ * Runs the config block and the key block at construction and keeps the
+ * chaining value after the key. Each MAC then costs only the message
+ * blocks plus the output transform, and equals Skein3::mac with the same
+ * key and config. The context is immutable after construction and can be
+ * shared between threads.
+ */
+class Skein3::MacContext {
+public:
+    MacContext(ByteView key, const Config& config = Config());
+    ~MacContext();
+
+    std::vector<uint8_t> mac(ByteView message) const;
+
+    /**
+     * @brief MAC into digest_size() bytes at digest
+     */
+    void mac(ByteView message, uint8_t* digest) const;
+
+    template <size_t Bits>
+    void mac(ByteView message, Digest<Bits>& digest) const {
+        if (Bits / 8 != hash_size_) {
+            throw std::invalid_argument("Digest size does not match config.size");
+        }
+        mac(message, digest.data());
+    }
+
+    /**
+     * @brief MAC many messages under this key through the multi-buffer engine
+     * @param digests Output, messages.size() * digest_size() bytes
+     */
+    void batch_mac(const std::vector<ByteView>& messages, uint8_t* digests) const;
+
+    std::vector<std::vector<uint8_t>> batch_mac(const std::vector<ByteView>& messages) const;
+
+    size_t digest_size() const { return hash_size_; }
+
+private:
+    std::array<uint64_t, Threefish3::NUM_WORDS> key_chain_;
+    Threefish3::SecurityMode sec_mode_;
+    size_t hash_size_;
+    bool secure_wipe_;
+};
+
+/**
+ * @brief Incremental hasher with constant memory
+ *
+ * Full blocks are compressed straight from the caller's buffer as they
+ * arrive. Only the most recent block is held back, because the last block
+ * carries the final flag. finalize() gives the same digest as
+ * Skein3::hash over the concatenated input with the same config.
+ */
+class Skein3::StreamingHasher {
+public:
+    /**
+     * @brief Initialize streaming hasher
+     * @param config Hash configuration
+     */
+    StreamingHasher(const Config& config = Config());
+
+    /**
+     * @brief Process new chunk of data
+     * @param data Input data chunk
+     */
+    void update(const std::vector<uint8_t>& data);
+    void update(ByteView data);
+    void update(const uint8_t* data, size_t size);
+
+    /**
+     * @brief Complete hash computation and reset for a new message
+     * @return Final hash value
+     */
+    std::vector<uint8_t> finalize();
+
+    /**
+     * @brief Complete hash computation into digest_size(config) bytes
+     */
+    void finalize(uint8_t* digest);
+
+    /**
+     * @brief Discard buffered input and start a new message
+     */
+    void reset();
+
+    /**
+     * @brief Total number of bytes passed to update() since the last reset
+     */
+    uint64_t bytes_processed() const { return total_bytes_; }
+
+    /**
+     * @brief Write the midstate so hashing can resume after a restart
+     *
+     * The checkpoint holds the chaining value, the position, a fingerprint
+     * of the config and the held-back tail of at most one block, which is
+     * raw message data; at most 624 bytes.
+     */
+    void save(std::ostream& out) const;
+    void save(const std::string& filename) const;
+
+    /**
+     * @brief Resume from a checkpoint written by save() with the same config
+     * @throws std::runtime_error on a damaged checkpoint or a config mismatch
+     */
+    static StreamingHasher load(std::istream& in, const Config& config = Config());
+    static StreamingHasher load(const std::string& filename, const Config& config = Config());
+
+private:
+    void compress(const uint8_t* block);
+
+    Config config_;
+    Threefish3::SecurityMode sec_mode_;
+    std::array<uint64_t, Threefish3::NUM_WORDS> iv_;
+    BlockContext ctx_;
+    std::array<uint8_t, Threefish3::BLOCK_SIZE> buffer_;
+    size_t buffered_;
+    uint64_t total_bytes_;
+};
+
+class Skein3::StreamingTreeHasher {
+public:
+    /**
+     * @brief Initialize a tree hasher with the same tree parameters as tree_hash
+     *
+     * Full runs of leaves are hashed on the shared thread pool while
+     * update() keeps accepting data; only the unfinished right edge of the
+     * tree and a bounded number of in-flight runs are held in memory.
+     */
+    explicit StreamingTreeHasher(const Config& config = Config());
+    ~StreamingTreeHasher();
+
+    StreamingTreeHasher(const StreamingTreeHasher&) = delete;
+    StreamingTreeHasher& operator=(const StreamingTreeHasher&) = delete;
+    StreamingTreeHasher(StreamingTreeHasher&&) = default;
+
+    void update(const std::vector<uint8_t>& data);
+    void update(ByteView data);
+    void update(const uint8_t* data, size_t size);
+
+    /**
+     * @brief Complete the tree and reset for a new message
+     * @return The digest tree_hash gives for all data passed to update()
+     */
+    std::vector<uint8_t> finalize();
+    void finalize(uint8_t* digest);
+
+    /**
+     * @brief Drop buffered input and pending work and start a new message
+     */
+    void reset();
+
+    uint64_t bytes_processed() const { return total_bytes_; }
+
+    /**
+     * @brief Write the midstate so hashing can resume after a restart
+     *
+     * Waits for the runs in flight and hashes the whole leaves of the
+     * current run, so the checkpoint is the right edge of the tree (under
+     * tree_fan_out digests per height) plus less than one leaf of raw
+     * message data. The digest is unaffected; the rest of the current run
+     * is then hashed leaf by leaf on the calling thread.
+     */
+    void save(std::ostream& out);
+    void save(const std::string& filename);
+
+    /**
+     * @brief Resume from a checkpoint written by save() with the same config
+     * @throws std::runtime_error on a damaged checkpoint or a config mismatch
+     */
+    static StreamingTreeHasher load(std::istream& in, const Config& config = Config());
+    static StreamingTreeHasher load(const std::string& filename, const Config& config = Config());
+
+private:
+    struct Job;
+
+    void submit_run();
+    void retire_oldest();
+    void push_node(size_t height, const uint8_t* digest);
+    void hash_pending(size_t height, uint8_t* parent);
+    void hash_leaves(size_t bytes);
+
+    std::shared_ptr<const TreeShape> shape_;
+    size_t run_height_;
+    size_t run_bytes_;
+    size_t max_jobs_;
+    std::vector<uint8_t> run_;
+    // Bytes of the current run already hashed as leaves into pending_
+    size_t run_offset_;
+    std::deque<std::shared_ptr<Job>> jobs_;
+    std::vector<std::vector<uint8_t>> spare_runs_;
+    // Digests waiting for their siblings, per height
+    std::vector<std::vector<uint8_t>> pending_;
+    uint64_t total_bytes_;
+};
+
+class Skein3::TreeState {
+public:
+    /**
+     * @brief Empty state; the first update() hashes the whole content
+     */
+    explicit TreeState(const Config& config = Config());
+
+    /**
+     * @brief Hash data and keep every node of its tree
+     */
+    TreeState(ByteView data, const Config& config = Config());
+
+    /**
+     * @brief Re-hash after bytes [begin, end) of the content changed
+     *
+     * data is the whole current content. Only the leaves overlapping the
+     * range and their paths to the root are hashed again. If data.size
+     * differs from size(), the content grew or shrank and everything from
+     * begin to the new end counts as changed.
+     */
+    void update(ByteView data, uint64_t begin, uint64_t end);
+
+    /**
+     * @brief The tree_hash digest of the current content
+     */
+    std::vector<uint8_t> root() const;
+    void root(uint8_t* digest) const;
+
+    uint64_t size() const { return size_; }
+    size_t leaf_count() const { return levels_.empty() ? 0 : levels_[0].size() / shape_.hash_size; }
+
+    /**
+     * @brief Write the node cache so edits can continue after a restart
+     */
+    void save(std::ostream& out) const;
+    void save(const std::string& filename) const;
+
+    /**
+     * @brief Read a node cache written by save() with the same config
+     * @throws std::runtime_error on a damaged file or a config mismatch
+     */
+    static TreeState load(std::istream& in, const Config& config = Config());
+    static TreeState load(const std::string& filename, const Config& config = Config());
+
+private:
+    void rehash(ByteView data, size_t first_leaf, size_t end_leaf);
+
+    TreeShape shape_;
+    uint64_t size_;
+    // levels_[h] holds the digests of height h; the last level is the root
+    std::vector<std::vector<uint8_t>> levels_;
+};
+
+/**
+ * @brief Digest manifest of a directory tree, kept up to date by stat data
+ *
+ * Works like git's index: every regular file is recorded with its size,
+ * mtime, ctime and inode next to its hash_file() digest. A later scan()
+ * re-hashes only files whose stat data changed, or whose mtime was too
+ * close to the previous scan to be trusted. Directories are listed in
+ * parallel and files are hashed in parallel on the shared thread pool.
+ * Symbolic links and special files are skipped.
+ */
+class Skein3::DirectorySnapshot {
+public:
+    struct Entry {
+        std::string path;   // relative to the scanned directory, '/'-separated
+        uint64_t size;
+        int64_t mtime_ns;
+        int64_t ctime_ns;
+        uint64_t inode;
+    };
+
+    // A file or subdirectory the last scan() could not read
+    struct Failure {
+        std::string path;
+        std::string error;
+    };
+
+    explicit DirectorySnapshot(const Config& config = Config());
+
+    /**
+     * @brief Walk directory and bring the manifest up to date
+     *
+     * The current entries act as the index, so a snapshot that was loaded
+     * or scanned before only pays for files that changed since. A file or
+     * subdirectory that cannot be read is left out of the entries and
+     * listed in failures() instead of aborting the scan.
+     *
+     * @throws std::runtime_error if directory itself cannot be listed
+     */
+    void scan(const std::string& directory);
+
+    /**
+     * @brief Entries sorted by path, with digest(i) belonging to entries()[i]
+     */
+    const std::vector<Entry>& entries() const { return entries_; }
+    const uint8_t* digest(size_t index) const { return digests_.data() + index * hash_size_; }
+
+    /**
+     * @brief Paths the last scan() skipped, sorted, with the reason
+     */
+    const std::vector<Failure>& failures() const { return failures_; }
+
+    /**
+     * @brief MerkleTree root over the sorted manifest
+     *
+     * Leaf i holds the path length and path, the file size and the digest
+     * of entry i (lengths as 64-bit little-endian), and every leaf binds
+     * into the root. Stat times and inodes are not part of it, so the root
+     * depends only on names and contents. An empty manifest has the digest
+     * of the empty message as its root.
+     */
+    std::vector<uint8_t> root() const;
+    void root(uint8_t* digest) const;
+
+    /**
+     * @brief Files hashed by the last scan(); the others reused their digest
+     */
+    size_t files_hashed() const { return files_hashed_; }
+
+    /**
+     * @brief Write the index so the next run can skip unchanged files
+     */
+    void save(std::ostream& out) const;
+    void save(const std::string& filename) const;
+
+    /**
+     * @brief Read an index written by save() with the same config
+     * @throws std::runtime_error on a damaged file or a config mismatch
+     */
+    static DirectorySnapshot load(std::istream& in, const Config& config = Config());
+    static DirectorySnapshot load(const std::string& filename, const Config& config = Config());
+
+private:
+    Config config_;
+    size_t hash_size_;
+    // Chaining value of the file digests, identifying the config in saved indexes
+    std::array<uint64_t, Threefish3::NUM_WORDS> fingerprint_;
+    std::vector<Entry> entries_;
+    std::vector<uint8_t> digests_;
+    std::vector<Failure> failures_;
+    // Wall clock at the start of the last scan, in ns since the epoch
+    int64_t scan_time_ns_;
+    size_t files_hashed_;
+};
+
+/**
+ * @brief Incremental hashing of append-only files such as audit logs
+ *
+ * After each call the midstate of the file's streaming hasher is stored in
+ * a small state file. The next call resumes from it and reads only the
+ * bytes appended since, so a check costs time proportional to the new
+ * data. Before resuming, the state is checked against the file: the same
+ * inode and device, at least the hashed length, and an unchanged digest of
+ * the first 4 KiB and of the 64 KiB before the saved offset. If any check
+ * fails the file was truncated, replaced or rewritten, and it is hashed
+ * again from byte zero. Edits that stay entirely inside the middle of the
+ * already hashed part are not detected; run hash_file() for a full pass.
+ *
+ * The digest equals hash_file() of the whole file, or its tree_hash() with
+ * HashMode::TREE. Calls for different files may run concurrently.
+ */
+class Skein3::AppendHasher {
+public:
+    enum class Status {
+        FULL,       // no usable saved state, hashed from byte zero
+        APPENDED,   // resumed: only bytes after the saved offset were read
+        REWRITTEN   // saved state did not match the file, hashed from byte zero
+    };
+
+    struct Result {
+        std::vector<uint8_t> digest;
+        uint64_t size;          // bytes covered by digest
+        uint64_t bytes_hashed;  // bytes read and hashed by this call
+        Status status;
+    };
+
+    explicit AppendHasher(const Config& config = Config());
+
+    /**
+     * @brief Digest of the file's current contents, state in path + ".sk3state"
+     * @throws std::runtime_error if the file cannot be read or the state written
+     */
+    Result hash(const std::string& path) const;
+    Result hash(const std::string& path, const std::string& state_path) const;
+
+private:
+    Config config_;
+};
+
+/**
+ * @brief Authenticated reads of content known only by its tree_hash root
+ *
+ * The outboard holds the nodes of the tree_hash() tree, whose nodes bind
+ * every data byte and every child digest (tree format 2), so the root to
+ * trust is the tree_hash() digest, which write_outboard() also returns.
+ *
+ * The data and its outboard may come from an untrusted source; only the
+ * root and the content size must be trusted. Checking a range reads the
+ * covering leaves plus one group of sibling digests per tree level from
+ * the outboard, and each group is hashed and compared with its already
+ * verified parent. Verified groups stay cached, so a sequential pass reads
+ * every outboard node once.
+ *
+ * The outboard stream must stay valid and seekable while the reader is in
+ * use. A reader is not thread-safe; use one per thread.
+ */
+class Skein3::VerifiedReader {
+public:
+    // Version 1 outboards held tree format 1 nodes
+    static constexpr uint64_t FORMAT_VERSION = 2;
+
+    /**
+     * @throws std::invalid_argument if root has the wrong size or size is 0
+     * @throws std::runtime_error if the outboard header does not match
+     *         config and size
+     */
+    VerifiedReader(ByteView root, uint64_t size, std::istream& outboard,
+                   const Config& config = Config());
+
+    /**
+     * @brief Hash data on the worker pool and write its outboard
+     *
+     * The returned root equals tree_hash(data, config).
+     * Every node digest below the root, level by level from the leaves, at
+     * fixed offsets after a short header. There is no checksum: readers
+     * check each node they use against the root instead.
+     * @return The root to hand to readers over a trusted channel
+     * @throws std::invalid_argument for empty data
+     */
+    static std::vector<uint8_t> write_outboard(ByteView data, std::ostream& out,
+                                               const Config& config = Config());
+    static std::vector<uint8_t> write_outboard(ByteView data, const std::string& filename,
+                                               const Config& config = Config());
+
+    uint64_t size() const { return size_; }
+    size_t leaf_size() const { return shape_.leaf_size; }
+
+    /**
+     * @brief Smallest range covering [begin, end) that verify() accepts
+     *
+     * Ranges must start and end on leaf boundaries, or end at size().
+     */
+    std::pair<uint64_t, uint64_t> leaf_range(uint64_t begin, uint64_t end) const;
+
+    /**
+     * @brief Check that data is bytes [offset, offset + data.size) of the content
+     * @return false if the data or a needed outboard node is wrong or missing
+     * @throws std::invalid_argument if the range is not leaf_range() aligned
+     */
+    bool verify(uint64_t offset, ByteView data);
+
+    /**
+     * @brief Check the next bytes of a sequential read of the whole content
+     *
+     * Each leaf is checked as soon as it is complete, so the first
+     * verified() bytes can be used before the stream ends.
+     * @return false once any byte so far failed or the data is too long
+     */
+    bool update(ByteView data);
+
+    /**
+     * @brief Check the last partial leaf and that exactly size() bytes arrived
+     */
+    bool finish();
+
+    uint64_t verified() const { return position_; }
+
+private:
+    const uint8_t* trusted_node(size_t height, size_t index);
+
+
+    TreeShape shape_;
+    uint64_t size_;
+    std::istream& outboard_;
+    std::vector<uint8_t> root_;
+    // Nodes per height and where each height starts in the outboard
+    std::vector<size_t> counts_;
+    std::vector<uint64_t> offsets_;
+    // The last verified sibling group per height below the root, by parent index
+    std::vector<size_t> group_parent_;
+    std::vector<std::vector<uint8_t>> groups_;
+    std::vector<uint8_t> leaf_digests_;
+    // Sequential reads: the verified prefix and a partial leaf after it
+    uint64_t position_;
+    std::vector<uint8_t> buffer_;
+    bool failed_;
+};
+
+/**
+ * @brief Mutable Merkle tree whose nodes bind both children
+ *
+ * Keeps every level as a flat digest array. update() and append() only
+ * queue the new leaf bytes; root() hashes the queued leaves in one batch
+ * and then recomputes the union of their paths level by level, each level
+ * in parallel on the worker pool. A few thousand changes out of millions
+ * of leaves cost a few thousand hashes per level instead of a rebuild.
+ *
+ * Leaves and parents are hashed with ubi_bound() from initial_chain(),
+ * tagged FORMAT_VERSION << 32 | height, so every leaf byte and both
+ * children reach the digest. A last, odd node is hashed alone. This is
+ * not the legacy merkle_root() layout, whose parents keep only the left
+ * child.
+ *
+ * Proofs are read from the cached levels as digests back to back: a leaf's
+ * siblings from the bottom up, skipping levels where its node is the last,
+ * odd one. A multiproof holds, level by level and left to right, only the
+ * siblings that the given leaves cannot compute themselves.
+ */
+class Skein3::MerkleTree {
+public:
+    // merkle_root() is the legacy format 1
+    static constexpr uint64_t FORMAT_VERSION = 2;
+
+    explicit MerkleTree(const Config& config = Config());
+
+    /**
+     * @brief Hash leaves now; the levels above are built by the first root()
+     */
+    MerkleTree(const std::vector<ByteView>& leaves, const Config& config = Config());
+
+    /**
+     * @brief Number of leaves, queued appends included
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Replace leaf index; a later change to the same leaf wins
+     * @throws std::out_of_range if index >= size()
+     */
+    void update(size_t index, ByteView leaf);
+    void append(ByteView leaf);
+
+    /**
+     * @brief Apply the queued changes and return the root of the leaves
+     * @throws std::invalid_argument if the tree has no leaves
+     */
+    std::vector<uint8_t> root();
+    void root(uint8_t* digest);
+
+    /**
+     * @brief Proof that leaf index is under root(); const, so threads can
+     * serve proofs concurrently between changes
+     * @throws std::out_of_range if index >= size()
+     * @throws std::runtime_error if changes were made since the last root()
+     */
+    std::vector<uint8_t> proof(size_t index) const;
+
+    /**
+     * @brief One proof for several leaves; equals proof() for a single index
+     * @throws std::invalid_argument unless indices are strictly increasing
+     */
+    std::vector<uint8_t> multiproof(const std::vector<size_t>& indices) const;
+
+    static bool verify_proof(ByteView root, size_t count, size_t index, ByteView leaf,
+                             ByteView proof, const Config& config = Config());
+    static bool verify_multiproof(ByteView root, size_t count,
+                                  const std::vector<size_t>& indices,
+                                  const std::vector<ByteView>& leaves,
+                                  ByteView proof, const Config& config = Config());
+
+    /**
+     * @brief True if verify_proof() accepts every proofs[i] for leaves[i]
+     * at indices[i] and the proofs agree on the nodes they share
+     *
+     * Nodes shared by several paths are hashed once and every level is
+     * hashed as one batch.
+     */
+    static bool verify_proofs(ByteView root, size_t count,
+                              const std::vector<size_t>& indices,
+                              const std::vector<ByteView>& leaves,
+                              const std::vector<ByteView>& proofs,
+                              const Config& config = Config());
+
+private:
+    struct Change {
+        size_t index;
+        size_t offset;
+        size_t size;
+    };
+
+    // Sorted node indices of one level and their digests
+    struct Nodes {
+        std::vector<size_t> index;
+        std::vector<uint8_t> digests;
+    };
+
+    void flush();
+    void check_applied() const;
+
+    /**
+     * @brief Hash the parents of every known node at height, a level of
+     * count nodes
+     *
+     * A child that is not known must be in siblings. Returns false if one
+     * is missing or a sibling is left over.
+     */
+    static bool hash_parents(const std::array<uint64_t, Threefish3::NUM_WORDS>& iv,
+                             size_t hash_size, size_t height, size_t count,
+                             const Nodes& known, const Nodes& siblings, Nodes& parents);
+
+    Config config_;
+    size_t hash_size_;
+    std::array<uint64_t, Threefish3::NUM_WORDS> iv_;
+    size_t size_;
+    // levels_[h] holds the digests of height h; the last level is the root
+    std::vector<std::vector<uint8_t>> levels_;
+    // Levels above the leaves are not built yet and are hashed in full
+    bool rebuild_;
+    std::vector<Change> changes_;
+    std::vector<uint8_t> change_bytes_;
+};
+
+/**
+ * @brief Merkle Mountain Range accumulator for append-only logs
+ *
+ * Leaves form perfect binary trees ("mountains") stored in post-order;
+ * appending a leaf adds it and merges equal-height peaks, O(1) amortized.
+ * The root bags the peaks from right to left. Proofs are digests back to
+ * back: an inclusion proof is the leaf's path to its peak followed by the
+ * other peaks, a consistency proof the old peaks followed by what joins
+ * them into the new peaks. Both are O(log n).
+ *
+ * A parent hashes its children zero padded to one full cipher block,
+ * then its height, so every child byte is absorbed; bagging uses height 0.
+ * Leaves are hashed with ubi_bound() from initial_chain(), so every leaf
+ * byte is absorbed too; version 1 node files, whose leaves were hash() of
+ * the leaf data, are refused.
+ */
+class Skein3::MerkleMountainRange {
+public:
+    /**
+     * @brief Empty range with every node in memory
+     */
+    explicit MerkleMountainRange(const Config& config = Config());
+
+    /**
+     * @brief Range whose nodes live in node_file, created if missing
+     *
+     * Only the peaks stay in memory. Reopening a file continues its log;
+     * nodes of a batch cut short by a crash are dropped.
+     * @throws std::runtime_error if the file cannot be used or was written
+     *         with a different config
+     */
+    MerkleMountainRange(const std::string& node_file, const Config& config = Config());
+
+    MerkleMountainRange(MerkleMountainRange&&) noexcept;
+    MerkleMountainRange& operator=(MerkleMountainRange&&) noexcept;
+    ~MerkleMountainRange();
+
+    uint64_t size() const { return size_; }
+
+    /**
+     * @brief Append one leaf and return its index
+     */
+    uint64_t append(ByteView leaf);
+
+    /**
+     * @brief Append leaves in order; leaves and each height of new parents
+     *        are hashed in multi-buffer batches
+     */
+    void append(const std::vector<ByteView>& leaves);
+
+    /**
+     * @throws std::invalid_argument if the range is empty
+     */
+    std::vector<uint8_t> root() const;
+    void root(uint8_t* digest) const;
+
+    template <size_t Bits>
+    void root(Digest<Bits>& digest) const {
+        if (Bits / 8 != hash_size_) {
+            throw std::invalid_argument("Digest size does not match config.size");
+        }
+        root(digest.data());
+    }
+
+    /**
+     * @brief Proof that leaf index is under root() at the current size
+     * @throws std::out_of_range if index >= size()
+     */
+    std::vector<uint8_t> inclusion_proof(uint64_t index) const;
+
+    /**
+     * @brief Proof that the range at old_size is a prefix of this one
+     * @throws std::out_of_range unless 0 < old_size <= size()
+     */
+    std::vector<uint8_t> consistency_proof(uint64_t old_size) const;
+
+    static bool verify_inclusion(ByteView root, uint64_t size, uint64_t index,
+                                 ByteView leaf, ByteView proof,
+                                 const Config& config = Config());
+
+    static bool verify_consistency(ByteView old_root, uint64_t old_size,
+                                   ByteView new_root, uint64_t new_size,
+                                   ByteView proof, const Config& config = Config());
+
+private:
+    using Chain = std::array<uint64_t, Threefish3::NUM_WORDS>;
+
+    /**
+     * @brief Hash count parent messages laid out by node_message()
+     */
+    static void hash_nodes(const Chain& iv, size_t hash_size, const uint8_t* messages,
+                           size_t count, uint8_t* digests);
+    static void hash_node(const Chain& iv, size_t hash_size, const uint8_t* left,
+                          const uint8_t* right, uint64_t height, uint8_t* digest);
+    static void bag_peaks(const Chain& iv, size_t hash_size, const uint8_t* peaks,
+                          size_t count, uint8_t* digest);
+
+    void read_node(uint64_t position, uint8_t* digest) const;
+    void write_nodes(uint64_t position, const uint8_t* digests, size_t count);
+
+    Config config_;
+    size_t hash_size_;
+    Chain iv_;
+    uint64_t size_;
+    uint64_t node_count_;
+    // Current peaks, left to right
+    std::vector<uint8_t> peaks_;
+    // Every node in post-order when kept in memory
+    std::vector<uint8_t> nodes_;
+    std::unique_ptr<std::fstream> file_;
+};
+
+namespace std {
+    template <size_t Bits>
+    struct hash<Skein3::Digest<Bits>> {
+        // Digest bytes are already uniformly distributed
+        size_t operator()(const Skein3::Digest<Bits>& digest) const {
+            size_t value;
+            std::memcpy(&value, digest.data(), sizeof(value));
+            return value;
+        }
+    };
+}
+
 #endif // SKEIN3_H
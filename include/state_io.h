@@ -0,0 +1,143 @@
+#ifndef STATE_IO_H
+#define STATE_IO_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "skein3.h"
+
+/**
+ * @brief Writer for the library's saved state files
+ *
+ * Fields are little-endian 64-bit words or raw bytes. finish() appends a
+ * 256-bit Skein3 digest of everything written, sealed with its length and
+ * a zero block so that every byte reaches it, which StateReader checks.
+ * name ("tree state", "snapshot index", ...) is used in error messages.
+ */
+class StateWriter {
+public:
+    StateWriter(std::ostream& out, const char* name)
+        : out_(out), name_(name), checksum_(checksum_config()) {}
+
+    void bytes(const void* data, size_t size) {
+        out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        checksum_.update(static_cast<const uint8_t*>(data), size);
+        length_ += size;
+    }
+
+    void u64(uint64_t value) {
+        uint8_t encoded[8];
+        for (size_t i = 0; i < 8; ++i) {
+            encoded[i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+        bytes(encoded, sizeof(encoded));
+    }
+
+    void finish() {
+        auto digest = seal(checksum_, length_);
+        out_.write(reinterpret_cast<const char*>(digest.data()),
+                   static_cast<std::streamsize>(digest.size()));
+        out_.flush();
+        if (!out_) {
+            throw std::runtime_error(std::string("Could not write ") + name_);
+        }
+    }
+
+    static Skein3::Config checksum_config() {
+        Skein3::Config config;
+        config.size = Skein3::HashSize::HASH_256;
+        return config;
+    }
+
+    /**
+     * @brief Finalize hasher after its length word and a zero block
+     *
+     * Only the first digest-size bytes of the final block reach the
+     * digest, so the zero block keeps every hashed byte out of it, and the
+     * length tells apart inputs that differ only in trailing zeros.
+     */
+    static std::vector<uint8_t> seal(Skein3::StreamingHasher& hasher, uint64_t length) {
+        uint8_t end[Threefish3::BLOCK_SIZE] = {};
+        for (size_t i = 0; i < 8; ++i) {
+            end[i] = static_cast<uint8_t>(length >> (8 * i));
+        }
+        hasher.update(end, 8);
+        std::fill(end, end + 8, uint8_t(0));
+        hasher.update(end, sizeof(end));
+        return hasher.finalize();
+    }
+
+private:
+    std::ostream& out_;
+    const char* name_;
+    Skein3::StreamingHasher checksum_;
+    uint64_t length_ = 0;
+};
+
+/**
+ * @brief Reader for files written by StateWriter
+ *
+ * Every read throws std::runtime_error if the input ends early, and
+ * finish() throws unless the trailing checksum matches.
+ */
+class StateReader {
+public:
+    StateReader(std::istream& in, const char* name)
+        : in_(in), name_(name), checksum_(StateWriter::checksum_config()) {}
+
+    void bytes(void* data, size_t size) {
+        in_.read(static_cast<char*>(data), static_cast<std::streamsize>(size));
+        if (static_cast<size_t>(in_.gcount()) != size) {
+            throw std::runtime_error(std::string("Truncated ") + name_);
+        }
+        checksum_.update(static_cast<const uint8_t*>(data), size);
+        length_ += size;
+    }
+
+    // Grows the buffer as data arrives, so a damaged length cannot
+    // trigger a huge allocation before the stream runs out
+    void bytes(std::vector<uint8_t>& out, uint64_t size) {
+        const size_t step = 1 << 20;
+        out.clear();
+        while (out.size() < size) {
+            const size_t offset = out.size();
+            const size_t take = static_cast<size_t>(std::min<uint64_t>(step, size - offset));
+            out.resize(offset + take);
+            bytes(out.data() + offset, take);
+        }
+    }
+
+    uint64_t u64() {
+        uint8_t encoded[8];
+        bytes(encoded, sizeof(encoded));
+        uint64_t value = 0;
+        for (size_t i = 0; i < 8; ++i) {
+            value |= static_cast<uint64_t>(encoded[i]) << (8 * i);
+        }
+        return value;
+    }
+
+    void finish() {
+        auto expected = StateWriter::seal(checksum_, length_);
+        std::vector<uint8_t> stored(expected.size());
+        in_.read(reinterpret_cast<char*>(stored.data()),
+                 static_cast<std::streamsize>(stored.size()));
+        if (static_cast<size_t>(in_.gcount()) != stored.size() || stored != expected) {
+            throw std::runtime_error(std::string("Checksum mismatch in ") + name_);
+        }
+    }
+
+private:
+    std::istream& in_;
+    const char* name_;
+    Skein3::StreamingHasher checksum_;
+    uint64_t length_ = 0;
+};
+
+#endif // STATE_IO_H
@@ -8,6 +8,10 @@
 #include <mutex>
 #include <condition_variable>
 #include <future>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <algorithm>
 
 class ThreadPool {
 public:
@@ -16,6 +20,72 @@ public:
     ThreadPool(const ThreadPool&) = delete;
     ThreadPool& operator=(const ThreadPool&) = delete;
 
+    /**
+     * @brief Process-wide pool with one worker per hardware thread
+     *
+     * Created on first use and shared by every caller, so parallel hashing
+     * pays no thread start-up cost per call.
+     */
+    static ThreadPool& shared();
+
+    size_t size() const { return workers_.size(); }
+
+    /**
+     * @brief Run body(i) for every i in [0, count) and wait for all of them
+     *
+     * The calling thread works through indices as well, so this makes
+     * progress even when every worker is busy, including when it is called
+     * from a task running on this pool. The first exception thrown by body
+     * is rethrown here.
+     */
+    template<class F>
+    void parallel_for(size_t count, F&& body) {
+        if (count == 0) {
+            return;
+        }
+
+        struct State {
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> finished{0};
+            std::mutex mutex;
+            std::condition_variable done;
+            std::exception_ptr error;
+        };
+        auto state = std::make_shared<State>();
+
+        // Helpers that start after the last index was taken exit without
+        // touching body, so it only has to live until the wait below ends
+        auto run = [state, count, &body]() {
+            size_t i;
+            while ((i = state->next.fetch_add(1)) < count) {
+                try {
+                    body(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (!state->error) {
+                        state->error = std::current_exception();
+                    }
+                }
+                if (state->finished.fetch_add(1) + 1 == count) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->done.notify_all();
+                }
+            }
+        };
+
+        const size_t helpers = std::min(workers_.size(), count - 1);
+        for (size_t h = 0; h < helpers; ++h) {
+            enqueue(run);
+        }
+        run();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->done.wait(lock, [&]() { return state->finished.load() == count; });
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+    }
+
     template<class F>
     std::future<void> enqueue(F&& f) {
         auto task = std::make_shared<std::packaged_task<void()>>(std::forward<F>(f));
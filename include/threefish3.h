@@ -8,9 +8,10 @@
 #include <random>
 #include <algorithm>
 #include <numeric>
-#include <immintrin.h>
 #include "thread_pool.h"
 
+struct Threefish3Kernels;
+
 class Threefish3 {
 public:
     // Sabitler
@@ -33,6 +34,95 @@ public:
         ADAPTIVE
     };
 
+    /**
+     * @brief Kernel implementations compiled into the library
+     *
+     * The best one the CPU supports is picked on first use. The
+     * SKEIN3_BACKEND environment variable ("scalar", "avx2", "avx512") or
+     * set_backend() override the choice, e.g. to cross-check backends.
+     */
+    enum class Backend {
+        SCALAR,
+        AVX2,
+        AVX512
+    };
+
+    static bool backend_supported(Backend backend);
+    static Backend active_backend();
+    static const char* backend_name(Backend backend);
+
+    /**
+     * @brief Force a kernel backend for the whole process
+     * @throws std::invalid_argument if the backend is not compiled in or
+     *         the CPU does not support it
+     */
+    static void set_backend(Backend backend);
+
+    /**
+     * @brief Rekeyable cipher context with a precomputed key schedule
+     *
+     * Keeps the key schedule between blocks so the UBI loop can rekey in
+     * place from the chaining value instead of constructing a new
+     * Threefish3 for every block.
+     */
+    class Context {
+    public:
+        Context();
+        explicit Context(const std::array<uint64_t, NUM_WORDS>& key);
+
+        void rekey(const std::array<uint64_t, NUM_WORDS>& key);
+
+        void encrypt(const std::array<uint64_t, NUM_WORDS>& plaintext,
+                     std::array<uint64_t, NUM_WORDS>& ciphertext) const;
+
+        /**
+         * @brief One UBI step: chain = E(chain, block) ^ block
+         * @param chain Chaining value, used as the key and overwritten
+         * @param block BLOCK_SIZE bytes of input, no alignment required
+         */
+        void ubi(std::array<uint64_t, NUM_WORDS>& chain, const uint8_t* block);
+
+    private:
+        alignas(32) std::array<uint64_t, NUM_WORDS> key_schedule_;
+    };
+
+    /**
+     * @brief One UBI step without a context: out = E(chain, block) ^ block
+     *
+     * For single-block messages, where keeping a key schedule around buys
+     * nothing. out may alias chain.
+     */
+    static void ubi_block(const std::array<uint64_t, NUM_WORDS>& chain,
+                          const uint8_t* block,
+                          std::array<uint64_t, NUM_WORDS>& out);
+
+    /**
+     * @brief Widest multi-buffer group supported by any kernel
+     */
+    static constexpr size_t MAX_LANES = 8;
+
+    /**
+     * @brief Number of independent chains one multi-buffer pass processes
+     * @return 8 with the AVX-512 backend, 1 otherwise
+     */
+    static size_t multi_buffer_lanes();
+
+    /**
+     * @brief Multi-buffer UBI over independent chaining values
+     *
+     * Equivalent to Context::ubi on every (chains[i], blocks[i]) pair, but
+     * the chains are transposed into SIMD lanes so one pass of the round
+     * function advances multi_buffer_lanes() of them at once. Like
+     * encrypt(), the round function does not consume the tweak.
+     *
+     * @param chains Chaining values, overwritten in place
+     * @param blocks BLOCK_SIZE input bytes for each chain
+     * @param count Number of chains, any value
+     */
+    static void ubi_multi(std::array<uint64_t, NUM_WORDS>* const* chains,
+                          const uint8_t* const* blocks,
+                          size_t count);
+
     Threefish3(const std::array<uint64_t, NUM_WORDS>& state,
                const std::array<uint64_t, 3>& tweak,
                SecurityMode mode);
@@ -45,10 +135,6 @@ public:
     void decrypt(const std::array<uint64_t, NUM_WORDS>& ciphertext,
                 std::array<uint64_t, NUM_WORDS>& plaintext);
 
-    void simd_mix_function(__m256i& block, int round);
-    void simd_permute_words(std::array<__m256i, NUM_WORDS/4>& data);
-    void simd_inverse_mix_function(__m256i& block, int round);
-
     void parallel_encrypt(const std::vector<uint8_t>& input,
                         std::vector<uint8_t>& output,
                         size_t num_threads);
@@ -82,6 +168,7 @@ private:
     std::vector<uint8_t> inverse_permutation_table_;
 
     void quantum_init();
+    static const Threefish3Kernels& kernels();
     void mix_function(uint64_t& x0, uint64_t& x1, int round);
     void permute_words(std::array<uint64_t, NUM_WORDS>& data);
     void inverse_mix_function(uint64_t& x0, uint64_t& x1, int round);
@@ -0,0 +1,135 @@
+#ifndef THREEFISH3_KERNELS_H
+#define THREEFISH3_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "threefish3.h"
+
+/**
+ * @brief Function table of one Threefish3 kernel backend
+ *
+ * Every backend lives in its own translation unit, compiled for its
+ * instruction set, and Threefish3 picks one at startup. Keys and blocks
+ * are NUM_WORDS 64-bit words. Sliced buffers are 64-byte aligned and hold
+ * word w of lane l at index w * lanes + l.
+ *
+ * Backend translation units must not instantiate inline library code
+ * (std::array, std::vector, ...): the linker may keep their copy of it for
+ * the whole program, including on CPUs without that instruction set.
+ */
+struct Threefish3Kernels {
+    const char* name;
+    size_t lanes;
+
+    // ciphertext may alias key; plaintext needs no alignment
+    void (*encrypt)(const uint64_t* key, const uint8_t* plaintext,
+                    uint64_t* ciphertext, bool feed_forward);
+    void (*decrypt)(const uint64_t* key, const uint64_t* tweak,
+                    const uint64_t* ciphertext, uint64_t* plaintext);
+
+    // chain = E(chain, block) ^ block for every lane, in place. Null when
+    // the backend is faster one block at a time (lanes is then 1).
+    void (*ubi_sliced)(uint64_t* chain, const uint64_t* block);
+};
+
+extern const Threefish3Kernels threefish3_scalar_kernels;
+#ifdef SKEIN3_X86_KERNELS
+extern const Threefish3Kernels threefish3_avx2_kernels;
+extern const Threefish3Kernels threefish3_avx512_kernels;
+#endif
+
+// Kernels are nested compile-time loops over rounds and words. Flattening
+// their entry points keeps the whole pipeline one straight-line function
+// instead of leaving it to the inliner's size limits.
+#if defined(__GNUC__) || defined(__clang__)
+#define THREEFISH3_FLATTEN __attribute__((flatten))
+#else
+#define THREEFISH3_FLATTEN
+#endif
+
+/**
+ * @brief Call f(std::integral_constant<size_t, I>()) for I = 0 .. Count - 1
+ *
+ * Kernels unroll with this so every round number, rotation amount and
+ * word index is a compile-time constant.
+ */
+template <typename F, size_t... I>
+inline void threefish3_unroll(F& f, std::index_sequence<I...>) {
+    (f(std::integral_constant<size_t, I>()), ...);
+}
+
+template <size_t Count, typename F>
+inline void threefish3_unroll(F f) {
+    threefish3_unroll(f, std::make_index_sequence<Count>());
+}
+
+/**
+ * @brief Compile-time schedule of one encryption round
+ *
+ * Each mix round is followed by rotating the block by one group of four
+ * words. The mix treats every word pair alike, and key injections are
+ * MIX_ROUNDS apart, i.e. a whole turn of the groups. So kernels leave the
+ * words in place and never perform the rotation.
+ */
+template <size_t Round>
+struct Threefish3Round {
+    static_assert(Threefish3::MIX_ROUNDS % (Threefish3::NUM_WORDS / 4) == 0 &&
+                  Threefish3::NUM_ROUNDS % (Threefish3::NUM_WORDS / 4) == 0,
+                  "word rotation must cancel between key injections");
+
+    static constexpr int ROTATION = Round % 7 + 45;
+    static constexpr bool INJECTS_KEY = Round % Threefish3::MIX_ROUNDS == 0;
+    static constexpr size_t KEY_ROUND = Round / Threefish3::MIX_ROUNDS;
+};
+
+/**
+ * @brief Fully unrolled encryption rounds over word-sliced lanes
+ *
+ * Lanes supplies Vector, load, store, add, bit_xor and rotl<R>; each
+ * backend instantiates this with its own (translation-unit local) Lanes
+ * type. output may alias key.
+ */
+template <typename Lanes, bool FeedForward>
+inline void threefish3_sliced_rounds(const uint64_t* key, const uint64_t* input,
+                                     uint64_t* output) {
+    constexpr size_t N = Threefish3::NUM_WORDS;
+    constexpr size_t L = Lanes::LANES;
+    typename Lanes::Vector k[N];
+    typename Lanes::Vector x[N];
+    threefish3_unroll<N>([&](auto w) {
+        k[w.value] = Lanes::load(key + w.value * L);
+        x[w.value] = Lanes::load(input + w.value * L);
+    });
+
+    threefish3_unroll<Threefish3::NUM_ROUNDS>([&](auto round) {
+        using Schedule = Threefish3Round<decltype(round)::value>;
+        if constexpr (Schedule::INJECTS_KEY) {
+            threefish3_unroll<N>([&](auto w) {
+                x[w.value] = Lanes::add(x[w.value], k[(w.value + 4 * Schedule::KEY_ROUND) % N]);
+            });
+        }
+
+        // Both words of a pair become (x0 + x1) ^ rotl(other word)
+        threefish3_unroll<N / 2>([&](auto pair) {
+            constexpr size_t a = 2 * decltype(pair)::value;
+            auto sum = Lanes::add(x[a], x[a + 1]);
+            auto x0 = Lanes::bit_xor(sum, Lanes::template rotl<Schedule::ROTATION>(x[a + 1]));
+            auto x1 = Lanes::bit_xor(sum, Lanes::template rotl<Schedule::ROTATION>(x[a]));
+            x[a] = x0;
+            x[a + 1] = x1;
+        });
+    });
+
+    threefish3_unroll<N>([&](auto w) {
+        auto out = x[w.value];
+        if (FeedForward) {
+            out = Lanes::bit_xor(out, Lanes::load(input + w.value * L));
+        }
+        Lanes::store(output + w.value * L, out);
+    });
+}
+
+#endif // THREEFISH3_KERNELS_H
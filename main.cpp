@@ -1,128 +1,454 @@
 #include "skein3.h"
-#include "security_monitor.h"
-#include "adaptive_security.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
-#include <iomanip>
+#include <mutex>
 #include <string>
 #include <vector>
-#include <chrono>
-#include <fstream>
 
-void printHash(const std::string& label, const std::vector<uint8_t>& hash) {
-    std::cout << label << ": ";
-    for (const uint8_t byte : hash) {
-        std::cout << std::hex << std::setw(2) << std::setfill('0') 
-                 << static_cast<int>(byte);
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+// sha256sum-compatible checksum tool:
+//   skein3_main [OPTION]... [FILE]...         print checksums
+//   skein3_main --check [OPTION]... [FILE]... verify checksum lists
+
+namespace {
+    const char* const PROGRAM = "skein3_main";
+
+    struct Options {
+        Skein3::Config config;
+        bool size_given = false;
+        bool check = false;
+        bool quiet = false;
+        bool status = false;
+        size_t jobs = 0;
+        std::vector<std::string> inputs;
+    };
+
+    // One file to hash, and for --check the digest it should have
+    struct Entry {
+        std::string path;
+        std::string expected;
+        Skein3::Config config;
+        std::string digest;
+        std::string error;
+    };
+
+    void printUsage(std::ostream& out) {
+        out << "Usage: " << PROGRAM << " [OPTION]... [FILE]...\n"
+            << "Print or check Skein3 checksums. Directories are hashed recursively.\n"
+            << "With no FILE, or when FILE is -, read standard input.\n\n"
+            << "  -s, --size BITS  digest size: 256, 512 (default) or 1024\n"
+            << "  -t, --tree       parallel tree hash (same digest for any thread count)\n"
+            << "  -j, --jobs N     hash up to N files at once (default: hardware threads)\n"
+            << "  -c, --check      read checksums from the FILEs and check them\n"
+            << "      --quiet      with --check, don't print OK for verified files\n"
+            << "      --status     with --check, print nothing; the exit status tells\n"
+            << "  -h, --help       display this help and exit\n\n"
+            << "1024-bit digests need a commercial license in SKEIN3_LICENSE.\n";
     }
-    std::cout << std::endl;
-}
 
-void printSecurityMetrics(const SecurityMonitor::SecurityMetrics& metrics) {
-    std::cout << "\nSecurity Metrics:" << std::endl;
-    std::cout << "Entropy Level: " << metrics.entropy_level << std::endl;
-    std::cout << "Pattern Complexity: " << metrics.pattern_complexity << std::endl;
-    std::cout << "Attack Probability: " << metrics.attack_probability << std::endl;
+    bool parseSize(const std::string& text, Skein3::HashSize& size) {
+        if (text == "256") {
+            size = Skein3::HashSize::HASH_256;
+        } else if (text == "512") {
+            size = Skein3::HashSize::HASH_512;
+        } else if (text == "1024") {
+            size = Skein3::HashSize::HASH_1024;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // Returns false after printing an error for a bad command line
+    bool parseOptions(int argc, char* argv[], Options& options, bool& help) {
+        bool only_files = false;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (only_files || arg == "-" || arg.empty() || arg[0] != '-') {
+                options.inputs.push_back(arg);
+                continue;
+            }
+            if (arg == "--") {
+                only_files = true;
+                continue;
+            }
+
+            // Options with a value accept "--size 256", "--size=256" and "-s 256"
+            std::string value;
+            bool has_value = false;
+            size_t equals = arg.find('=');
+            if (arg.compare(0, 2, "--") == 0 && equals != std::string::npos) {
+                value = arg.substr(equals + 1);
+                arg = arg.substr(0, equals);
+                has_value = true;
+            }
+            auto take_value = [&]() {
+                if (!has_value) {
+                    if (i + 1 >= argc) {
+                        return false;
+                    }
+                    value = argv[++i];
+                }
+                return true;
+            };
+
+            if (arg == "-h" || arg == "--help") {
+                help = true;
+            } else if (arg == "-t" || arg == "--tree") {
+                options.config.mode = Skein3::HashMode::TREE;
+            } else if (arg == "-c" || arg == "--check") {
+                options.check = true;
+            } else if (arg == "--quiet") {
+                options.quiet = true;
+            } else if (arg == "--status") {
+                options.status = true;
+            } else if (arg == "-s" || arg == "--size") {
+                if (!take_value() || !parseSize(value, options.config.size)) {
+                    std::cerr << PROGRAM << ": invalid digest size '" << value
+                              << "' (use 256, 512 or 1024)\n";
+                    return false;
+                }
+                options.size_given = true;
+            } else if (arg == "-j" || arg == "--jobs") {
+                char* end = nullptr;
+                unsigned long jobs = take_value() ? std::strtoul(value.c_str(), &end, 10) : 0;
+                if (jobs == 0 || end == value.c_str() || *end != '\0') {
+                    std::cerr << PROGRAM << ": invalid number of jobs '" << value << "'\n";
+                    return false;
+                }
+                options.jobs = jobs;
+            } else {
+                std::cerr << PROGRAM << ": unrecognized option '" << arg << "'\n"
+                          << "Try '" << PROGRAM << " --help' for more information.\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string toHex(const std::vector<uint8_t>& bytes) {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(bytes.size() * 2);
+        for (uint8_t byte : bytes) {
+            hex.push_back(digits[byte >> 4]);
+            hex.push_back(digits[byte & 0x0F]);
+        }
+        return hex;
+    }
+
+    // sha256sum escaping: names with a backslash or newline get a leading
+    // backslash on the line and those characters written as \\ and \n
+    bool needsEscape(const std::string& name) {
+        return name.find_first_of("\\\n") != std::string::npos;
+    }
+
+    std::string escapeName(const std::string& name) {
+        std::string escaped;
+        for (char c : name) {
+            if (c == '\\') {
+                escaped += "\\\\";
+            } else if (c == '\n') {
+                escaped += "\\n";
+            } else {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    bool unescapeName(const std::string& escaped, std::string& name) {
+        name.clear();
+        for (size_t i = 0; i < escaped.size(); ++i) {
+            if (escaped[i] != '\\') {
+                name += escaped[i];
+            } else if (i + 1 < escaped.size() && escaped[i + 1] == '\\') {
+                name += '\\';
+                ++i;
+            } else if (i + 1 < escaped.size() && escaped[i + 1] == 'n') {
+                name += '\n';
+                ++i;
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Regular files under a directory, in a stable order. A directory that
+    // cannot be listed is reported and skipped; returns false if any was
+    bool collectDirectory(const std::string& directory, std::vector<std::string>& paths) {
+        std::vector<std::string> found;
+        std::vector<std::filesystem::path> pending{directory};
+        bool complete = true;
+        while (!pending.empty()) {
+            const std::filesystem::path current = std::move(pending.back());
+            pending.pop_back();
+
+            // Symlinked directories are not followed, like recursive_directory_iterator
+            std::error_code error;
+            std::filesystem::directory_iterator item(current, error);
+            for (; !error && item != std::filesystem::directory_iterator(); item.increment(error)) {
+                std::error_code ignored;
+                if (!item->is_symlink(ignored) && item->is_directory(ignored)) {
+                    pending.push_back(item->path());
+                } else if (item->is_regular_file(ignored)) {
+                    found.push_back(item->path().string());
+                }
+            }
+            if (error) {
+                std::cerr << PROGRAM << ": " << current.string() << ": " << error.message() << "\n";
+                complete = false;
+            }
+        }
+        std::sort(found.begin(), found.end());
+        paths.insert(paths.end(), found.begin(), found.end());
+        return complete;
+    }
+
+    void hashEntry(Entry& entry) {
+        try {
+            std::vector<uint8_t> digest;
+            if (entry.path == "-") {
+#if defined(__unix__) || defined(__APPLE__)
+                digest = Skein3::hash_fd(STDIN_FILENO, entry.config);
+#else
+                digest = Skein3::hash_stream(std::cin, entry.config);
+#endif
+            } else {
+                digest = Skein3::hash_file(entry.path, entry.config);
+            }
+            entry.digest = toHex(digest);
+        } catch (const std::exception& e) {
+            entry.error = e.what();
+        }
+    }
+
+    // Parse "<hex>  <name>" or "<hex> *<name>" lines of one checksum list
+    bool readChecklist(std::istream& in, const std::string& list, const Options& options,
+                       std::vector<Entry>& entries, size_t& bad_lines) {
+        std::string line;
+        size_t number = 0;
+        bool any = false;
+        while (std::getline(in, line)) {
+            ++number;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            bool escaped = !line.empty() && line[0] == '\\';
+            std::string body = escaped ? line.substr(1) : line;
+
+            size_t hex_end = body.find(' ');
+            Entry entry;
+            entry.config = options.config;
+            bool valid = hex_end != std::string::npos && hex_end + 2 <= body.size() &&
+                         (body[hex_end + 1] == ' ' || body[hex_end + 1] == '*');
+            if (valid) {
+                entry.expected = body.substr(0, hex_end);
+                std::transform(entry.expected.begin(), entry.expected.end(),
+                               entry.expected.begin(), ::tolower);
+                valid = entry.expected.find_first_not_of("0123456789abcdef") == std::string::npos;
+
+                // Without --size the digest length tells the size
+                Skein3::HashSize size;
+                valid = valid && parseSize(std::to_string(entry.expected.size() * 4), size);
+                if (valid && !options.size_given) {
+                    entry.config.size = size;
+                }
+                std::string name = body.substr(hex_end + 2);
+                valid = valid && !name.empty() &&
+                        (!escaped || unescapeName(name, entry.path));
+                if (valid && !escaped) {
+                    entry.path = name;
+                }
+            }
+
+            if (!valid) {
+                ++bad_lines;
+                if (!options.status) {
+                    std::cerr << PROGRAM << ": " << list << ": " << number
+                              << ": improperly formatted Skein3 checksum line\n";
+                }
+                continue;
+            }
+            any = true;
+            entries.push_back(std::move(entry));
+        }
+        return any;
+    }
+
+    // Hash entries jobs at a time; report(i) runs in input order as soon
+    // as entry i and every entry before it are done
+    template <class Report>
+    void hashAll(std::vector<Entry>& entries, size_t jobs, Report report) {
+        std::vector<char> done(entries.size(), 0);
+        size_t next_report = 0;
+        std::mutex report_mutex;
+
+        ThreadPool pool(jobs - 1);
+        pool.parallel_for(entries.size(), [&](size_t i) {
+            hashEntry(entries[i]);
+            std::lock_guard<std::mutex> lock(report_mutex);
+            done[i] = 1;
+            while (next_report < entries.size() && done[next_report]) {
+                report(entries[next_report]);
+                ++next_report;
+            }
+        });
+    }
+
+    bool checkLicense(const Skein3::Config& config) {
+        if (config.size == Skein3::HashSize::HASH_1024 &&
+            !LicenseManager::getInstance().isCommercialUse()) {
+            std::cerr << PROGRAM << ": 1024-bit digests require a commercial license; "
+                      << "set SKEIN3_LICENSE\n";
+            return false;
+        }
+        return true;
+    }
 }
 
 int main(int argc, char* argv[]) {
     try {
-        // Lisans anahtarını çevresel değişkenden al
-        const char* license_key = std::getenv("SKEIN3_LICENSE");
-        if (!license_key) {
-            std::cerr << "License key not found. Please set SKEIN3_LICENSE environment variable.\n";
-            std::cerr << "Contact: your@email.com\n";
+        Options options;
+        bool help = false;
+        if (!parseOptions(argc, argv, options, help)) {
             return 1;
         }
+        if (help) {
+            printUsage(std::cout);
+            return 0;
+        }
 
-        // Lisansı ayarla
-        std::cout << "Setting license key: " << license_key << std::endl;  // Debug mesajı
-        LicenseManager::getInstance().setLicense(license_key);
-
-        // Lisans kontrolü
-        if (!LicenseManager::getInstance().isLicenseValid()) {
-            std::cerr << "No valid license found. Please obtain a license key.\n";
-            std::cerr << "Contact: your@email.com\n";
+        // Lisans anahtarı varsa çevresel değişkenden al
+        if (const char* license_key = std::getenv("SKEIN3_LICENSE")) {
+            LicenseManager::getInstance().setLicense(license_key);
+        }
+        if (options.size_given && !checkLicense(options.config)) {
             return 1;
         }
 
-        // Example message
-        std::string message = "This is a C++ implementation of the Skein3 hash function.";
-        std::vector<uint8_t> message_bytes(message.begin(), message.end());
+        if (options.jobs == 0) {
+            options.jobs = std::max(1u, std::thread::hardware_concurrency());
+        }
+        if (options.inputs.empty()) {
+            options.inputs.push_back("-");
+        }
+
+        int status = 0;
+        std::vector<Entry> entries;
 
-        // Basic hash with standard configuration
-        Skein3::Config config;
-        config.size = Skein3::HashSize::HASH_512;
-        config.mode = Skein3::HashMode::STANDARD;
-        
-        auto hash = Skein3::hash(message_bytes, config);
-        printHash("Standard Hash", hash);
-
-        // Security monitoring
-        auto metrics = SecurityMonitor::analyzeHashOperation(message_bytes, hash);
-        printSecurityMetrics(metrics);
-
-        // Adaptive security based on threat level
-        auto threat_level = AdaptiveSecurity::analyzeThreatLevel(message_bytes, metrics);
-        AdaptiveSecurity::adjustSecurityParameters(config, threat_level);
-
-        // Neural adaptation
-        config.neural_config.enable_neural_adaptation = true;
-        config.neural_config.complexity_threshold = 0.85f;
-        auto adapted_hash = Skein3::hash(message_bytes, config);
-        printHash("Neural Adapted Hash", adapted_hash);
-
-        // Parallel tree mode with memory protection
-        config.mode = Skein3::HashMode::TREE;
-        config.tree_fan_out = 4;
-        config.mem_protection = Skein3::MemoryProtectionMode::QUANTUM_RESISTANT;
-        auto tree_hash = Skein3::tree_hash(message_bytes, config);
-        printHash("Protected Tree Hash", tree_hash);
-
-        // Batch processing for AI workloads
-        std::vector<std::vector<uint8_t>> batch_messages;
-        for (int i = 0; i < 5; i++) {
-            batch_messages.push_back(message_bytes);
-        }
-        
-        config.batch_processing = true;
-        config.opt_mode = Skein3::OptimizationMode::AI_TRAINING;
-        auto batch_hashes = Skein3::batch_hash(batch_messages, config);
-        
-        std::cout << "\nBatch Processing Results:" << std::endl;
-        for (size_t i = 0; i < batch_hashes.size(); i++) {
-            printHash("Batch " + std::to_string(i), batch_hashes[i]);
-        }
-
-        // Blockchain features
-        std::vector<std::vector<uint8_t>> transactions = batch_messages;
-        config.opt_mode = Skein3::OptimizationMode::BLOCKCHAIN;
-        config.merkle_tree = true;
-        
-        auto merkle_root = Skein3::merkle_root(transactions, config);
-        printHash("Merkle Root", merkle_root);
-
-        // Performance metrics
-        std::cout << "\nPerformance Test:" << std::endl;
-        auto start = std::chrono::high_resolution_clock::now();
-        
-        const size_t num_iterations = 10000;
-        for (size_t i = 0; i < num_iterations; i++) {
-            Skein3::hash(message_bytes, config);
-        }
-        
-        auto end = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
-            end - start
-        ).count();
-        
-        double hashes_per_second = (num_iterations * 1000000.0) / duration;
-        std::cout << "Hashes per second: " << std::fixed << std::setprecision(2) 
-                 << hashes_per_second << std::endl;
+        if (!options.check) {
+            for (const auto& input : options.inputs) {
+                std::error_code error;
+                if (input != "-" && std::filesystem::is_directory(input, error)) {
+                    std::vector<std::string> paths;
+                    if (!collectDirectory(input, paths)) {
+                        status = 1;
+                    }
+                    for (auto& path : paths) {
+                        entries.push_back({path, "", options.config, "", ""});
+                    }
+                } else {
+                    entries.push_back({input, "", options.config, "", ""});
+                }
+            }
+
+            hashAll(entries, options.jobs, [&](const Entry& entry) {
+                if (!entry.error.empty()) {
+                    std::cout.flush();
+                    std::cerr << PROGRAM << ": " << entry.path << ": " << entry.error << "\n";
+                    status = 1;
+                    return;
+                }
+                if (needsEscape(entry.path)) {
+                    std::cout << '\\' << entry.digest << "  " << escapeName(entry.path) << '\n';
+                } else {
+                    std::cout << entry.digest << "  " << entry.path << '\n';
+                }
+            });
+            return status;
+        }
 
+        // --check: every list is parsed first, then all files are hashed together
+        size_t bad_lines = 0;
+        for (const auto& list : options.inputs) {
+            bool any;
+            if (list == "-") {
+                any = readChecklist(std::cin, "standard input", options, entries, bad_lines);
+            } else {
+                std::ifstream in(list);
+                if (!in.is_open()) {
+                    std::cerr << PROGRAM << ": " << list << ": No such file or directory\n";
+                    status = 1;
+                    continue;
+                }
+                any = readChecklist(in, list, options, entries, bad_lines);
+            }
+            if (!any) {
+                std::cerr << PROGRAM << ": " << list
+                          << ": no properly formatted Skein3 checksum lines found\n";
+                status = 1;
+            }
+        }
+        for (const auto& entry : entries) {
+            if (!checkLicense(entry.config)) {
+                return 1;
+            }
+        }
+
+        size_t mismatched = 0;
+        size_t unreadable = 0;
+        hashAll(entries, options.jobs, [&](const Entry& entry) {
+            const bool ok = entry.error.empty() && entry.digest == entry.expected;
+            if (!entry.error.empty()) {
+                ++unreadable;
+                if (!options.status) {
+                    std::cout.flush();
+                    std::cerr << PROGRAM << ": " << entry.path << ": " << entry.error << "\n";
+                }
+            } else if (!ok) {
+                ++mismatched;
+            }
+            if (options.status || (ok && options.quiet)) {
+                return;
+            }
+            const std::string name = needsEscape(entry.path) ?
+                "\\" + escapeName(entry.path) : entry.path;
+            std::cout << name << ": "
+                      << (ok ? "OK" : entry.error.empty() ? "FAILED" : "FAILED open or read")
+                      << '\n';
+        });
+
+        if (!options.status) {
+            std::cout.flush();
+            if (bad_lines > 0) {
+                std::cerr << PROGRAM << ": WARNING: " << bad_lines << " line"
+                          << (bad_lines == 1 ? " is" : "s are") << " improperly formatted\n";
+            }
+            if (unreadable > 0) {
+                std::cerr << PROGRAM << ": WARNING: " << unreadable << " listed file"
+                          << (unreadable == 1 ? "" : "s") << " could not be read\n";
+            }
+            if (mismatched > 0) {
+                std::cerr << PROGRAM << ": WARNING: " << mismatched << " computed checksum"
+                          << (mismatched == 1 ? " did" : "s did") << " NOT match\n";
+            }
+        }
+        if (mismatched > 0 || unreadable > 0) {
+            status = 1;
+        }
+        return status;
     } catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
+        std::cerr << PROGRAM << ": " << e.what() << std::endl;
         return 1;
     }
-
-    return 0;
 }
@@ -26,37 +26,43 @@ std::vector<uint8_t> BlockchainFeatures::optimizedMerkleRoot(
         throw std::invalid_argument("Empty transaction list");
     }
 
-    std::vector<std::vector<uint8_t>> current_level = transactions;
+    if (transactions.size() == 1) {
+        return transactions[0];
+    }
+
     Skein3::Config config;
     config.size = Skein3::HashSize::HASH_512;
     config.merkle_tree = true;
 
-    while (current_level.size() > 1) {
-        std::vector<std::vector<uint8_t>> next_level;
-        
-        #pragma omp parallel for
-        for (size_t i = 0; i < current_level.size(); i += 2) {
-            std::vector<uint8_t> combined;
-            combined.insert(combined.end(), 
-                          current_level[i].begin(), 
-                          current_level[i].end());
-
-            if (i + 1 < current_level.size()) {
-                combined.insert(combined.end(),
-                              current_level[i + 1].begin(),
-                              current_level[i + 1].end());
-            }
-
-            auto hash = Skein3::hash(combined, config);
-
-            #pragma omp critical
-            next_level.push_back(hash);
+    // The first level hashes pairs of raw transactions, copied back to back
+    // into one buffer; the levels above are plain digest pairs
+    std::vector<size_t> offsets{0};
+    for (size_t i = 0; i < transactions.size(); i += 2) {
+        size_t size = transactions[i].size();
+        if (i + 1 < transactions.size()) {
+            size += transactions[i + 1].size();
         }
+        offsets.push_back(offsets.back() + size);
+    }
+    std::vector<uint8_t> combined;
+    combined.reserve(offsets.back());
+    for (const auto& transaction : transactions) {
+        combined.insert(combined.end(), transaction.begin(), transaction.end());
+    }
 
-        current_level = std::move(next_level);
+    std::vector<Skein3::ByteView> pairs;
+    pairs.reserve(offsets.size() - 1);
+    for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+        pairs.emplace_back(combined.data() + offsets[i], offsets[i + 1] - offsets[i]);
     }
 
-    return current_level[0];
+    const size_t hash_size = Skein3::digest_size(config);
+    std::vector<uint8_t> level(pairs.size() * hash_size);
+    Skein3::batch_hash(pairs, level.data(), config);
+
+    std::vector<uint8_t> root(hash_size);
+    Skein3::merkle_root_from_digests(level.data(), pairs.size(), root.data(), config);
+    return root;
 }
 
 bool BlockchainFeatures::verifySmartContract(
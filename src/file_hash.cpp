@@ -0,0 +1,584 @@
+#include "skein3.h"
+#include "state_io.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <condition_variable>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SKEIN3_POSIX_FILES 1
+#endif
+
+// File hashing: map the file and hash the pages in place, or read it in
+// large blocks on an I/O thread when it cannot be mapped (pipes, sockets,
+// devices, procfs, std::istream)
+
+namespace {
+    constexpr size_t READ_BLOCK_SIZE = 4 * 1024 * 1024;
+    constexpr size_t READ_AHEAD_BLOCKS = 3;
+
+    bool is_tree(const Skein3::Config& config) {
+        return config.mode == Skein3::HashMode::TREE;
+    }
+
+    // Streaming hasher matching hash() or tree_hash(), whichever the config asks for
+    class FileDigest {
+    public:
+        explicit FileDigest(const Skein3::Config& config) {
+            if (is_tree(config)) {
+                tree_ = std::make_unique<Skein3::StreamingTreeHasher>(config);
+            } else {
+                plain_ = std::make_unique<Skein3::StreamingHasher>(config);
+            }
+        }
+
+        void update(const uint8_t* data, size_t size) {
+            if (tree_) {
+                tree_->update(data, size);
+            } else {
+                plain_->update(data, size);
+            }
+        }
+
+        // Resume from a checkpoint written by save()
+        FileDigest(std::istream& checkpoint, const Skein3::Config& config) {
+            if (is_tree(config)) {
+                tree_ = std::make_unique<Skein3::StreamingTreeHasher>(
+                    Skein3::StreamingTreeHasher::load(checkpoint, config));
+            } else {
+                plain_ = std::make_unique<Skein3::StreamingHasher>(
+                    Skein3::StreamingHasher::load(checkpoint, config));
+            }
+        }
+
+        void finalize(uint8_t* digest) {
+            if (tree_) {
+                tree_->finalize(digest);
+            } else {
+                plain_->finalize(digest);
+            }
+        }
+
+        void save(std::ostream& out) {
+            if (tree_) {
+                tree_->save(out);
+            } else {
+                plain_->save(out);
+            }
+        }
+
+    private:
+        std::unique_ptr<Skein3::StreamingHasher> plain_;
+        std::unique_ptr<Skein3::StreamingTreeHasher> tree_;
+    };
+
+#ifdef SKEIN3_POSIX_FILES
+    class FileDescriptor {
+    public:
+        explicit FileDescriptor(int fd) : fd_(fd) {}
+        ~FileDescriptor() {
+            if (fd_ >= 0) {
+                ::close(fd_);
+            }
+        }
+        FileDescriptor(const FileDescriptor&) = delete;
+        FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+        int get() const { return fd_; }
+
+    private:
+        int fd_;
+    };
+
+    // Read-only private mapping of a whole file; data() is null if mmap failed
+    class MappedRegion {
+    public:
+        MappedRegion(int fd, size_t size) : size_(size) {
+            void* address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            data_ = address == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(address);
+            if (data_) {
+                // Hints only: aggressive read-ahead, and huge pages where
+                // the kernel supports them for file mappings
+                void* start = const_cast<uint8_t*>(data_);
+                ::madvise(start, size_, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+                ::madvise(start, size_, MADV_HUGEPAGE);
+#endif
+            }
+        }
+        ~MappedRegion() {
+            if (data_) {
+                ::munmap(const_cast<uint8_t*>(data_), size_);
+            }
+        }
+        MappedRegion(const MappedRegion&) = delete;
+        MappedRegion& operator=(const MappedRegion&) = delete;
+
+        const uint8_t* data() const { return data_; }
+        size_t size() const { return size_; }
+
+    private:
+        const uint8_t* data_;
+        size_t size_;
+    };
+
+#endif
+
+    // Reads up to size bytes into block, returning 0 only at end of input
+    using ReadFunction = std::function<size_t(uint8_t* block, size_t size)>;
+
+    // Page-aligned read block, so the kernel can copy whole pages
+    struct FreeDeleter {
+        void operator()(uint8_t* p) const { std::free(p); }
+    };
+    using ReadBlock = std::unique_ptr<uint8_t, FreeDeleter>;
+
+    ReadBlock allocate_read_block() {
+        void* block = nullptr;
+#ifdef SKEIN3_POSIX_FILES
+        if (::posix_memalign(&block, 4096, READ_BLOCK_SIZE) != 0) {
+            block = nullptr;
+        }
+#else
+        block = std::malloc(READ_BLOCK_SIZE);
+#endif
+        if (!block) {
+            throw std::bad_alloc();
+        }
+        return ReadBlock(static_cast<uint8_t*>(block));
+    }
+
+    // Ring of read blocks filled by an I/O thread while the caller hashes
+    // the blocks already filled. Blocks are handed out in read order; the
+    // one returned by next() stays untouched until the following call.
+    class ReadAhead {
+    public:
+        explicit ReadAhead(ReadFunction read)
+            : read_(std::move(read)) {
+            for (auto& block : blocks_) {
+                block.data = allocate_read_block();
+            }
+            io_thread_ = std::thread([this]() { run(); });
+        }
+
+        ~ReadAhead() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            changed_.notify_all();
+            io_thread_.join();
+        }
+
+        ReadAhead(const ReadAhead&) = delete;
+        ReadAhead& operator=(const ReadAhead&) = delete;
+
+        // Next filled block, or an empty view at end of input
+        Skein3::ByteView next() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (holding_) {
+                head_ = (head_ + 1) % READ_AHEAD_BLOCKS;
+                --used_;
+                holding_ = false;
+                changed_.notify_all();
+            }
+            changed_.wait(lock, [this]() { return used_ > 0 || finished_; });
+            if (used_ == 0) {
+                if (error_) {
+                    std::rethrow_exception(error_);
+                }
+                return Skein3::ByteView();
+            }
+            holding_ = true;
+            return Skein3::ByteView(blocks_[head_].data.get(), blocks_[head_].size);
+        }
+
+    private:
+        struct Block {
+            ReadBlock data;
+            size_t size = 0;
+        };
+
+        void run() {
+            for (;;) {
+                size_t index;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    changed_.wait(lock, [this]() { return stop_ || used_ < READ_AHEAD_BLOCKS; });
+                    if (stop_) {
+                        return;
+                    }
+                    // head_ + used_ is unchanged by the consumer releasing a block
+                    index = (head_ + used_) % READ_AHEAD_BLOCKS;
+                }
+
+                size_t got = 0;
+                std::exception_ptr error;
+                try {
+                    got = read_(blocks_[index].data.get(), READ_BLOCK_SIZE);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (error || got == 0) {
+                    error_ = error;
+                    finished_ = true;
+                    changed_.notify_all();
+                    return;
+                }
+                blocks_[index].size = got;
+                ++used_;
+                changed_.notify_all();
+            }
+        }
+
+        ReadFunction read_;
+        std::array<Block, READ_AHEAD_BLOCKS> blocks_;
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        // Blocks filled or held by the consumer, starting at head_
+        size_t head_ = 0;
+        size_t used_ = 0;
+        bool holding_ = false;
+        bool finished_ = false;
+        bool stop_ = false;
+        std::exception_ptr error_;
+        std::thread io_thread_;
+    };
+
+    void hash_read_ahead(ReadFunction read, uint8_t* digest, const Skein3::Config& config) {
+        FileDigest hasher(config);
+        ReadAhead blocks(std::move(read));
+        for (Skein3::ByteView block = blocks.next(); block.size > 0; block = blocks.next()) {
+            hasher.update(block.data, block.size);
+        }
+        hasher.finalize(digest);
+    }
+
+#ifdef SKEIN3_POSIX_FILES
+    ReadFunction read_descriptor(int fd) {
+        return [fd](uint8_t* block, size_t size) -> size_t {
+            for (;;) {
+                ssize_t got = ::read(fd, block, size);
+                if (got >= 0) {
+                    return static_cast<size_t>(got);
+                }
+                if (errno != EINTR) {
+                    throw std::runtime_error("Could not read file");
+                }
+            }
+        };
+    }
+#endif
+
+    ReadFunction read_stream(std::istream& in) {
+        return [&in](uint8_t* block, size_t size) -> size_t {
+            in.read(reinterpret_cast<char*>(block), static_cast<std::streamsize>(size));
+            if (in.bad()) {
+                throw std::runtime_error("Could not read stream");
+            }
+            return static_cast<size_t>(in.gcount());
+        };
+    }
+}
+
+// Append hashing: resume the file's hasher from the state saved last time
+namespace {
+    constexpr char APPEND_STATE_MAGIC[8] = {'S', 'K', '3', 'A', 'P', 'P', 'N', 'D'};
+    constexpr uint64_t APPEND_STATE_VERSION = 2;
+    constexpr size_t APPEND_HEAD_BYTES = 4096;
+    constexpr size_t APPEND_TAIL_BYTES = 64 * 1024;
+    constexpr size_t SAMPLE_DIGEST_SIZE = 32;
+
+    // A regular file read at arbitrary offsets: from a mapping where
+    // possible, otherwise into a buffer
+    class InputFile {
+    public:
+        explicit InputFile(const std::string& path) {
+#ifdef SKEIN3_POSIX_FILES
+            file_ = std::make_unique<FileDescriptor>(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+            struct stat info;
+            if (file_->get() < 0 || ::fstat(file_->get(), &info) != 0) {
+                throw std::runtime_error("Could not open file for reading");
+            }
+            size_ = static_cast<uint64_t>(info.st_size);
+            inode_ = static_cast<uint64_t>(info.st_ino);
+            device_ = static_cast<uint64_t>(info.st_dev);
+            if (size_ > 0 && size_ <= SIZE_MAX) {
+                region_ = std::make_unique<MappedRegion>(file_->get(), static_cast<size_t>(size_));
+            }
+#else
+            file_.open(path, std::ios::binary | std::ios::ate);
+            if (!file_.is_open()) {
+                throw std::runtime_error("Could not open file for reading");
+            }
+            size_ = static_cast<uint64_t>(file_.tellg());
+#endif
+        }
+
+        uint64_t size() const { return size_; }
+        uint64_t inode() const { return inode_; }
+        uint64_t device() const { return device_; }
+
+        // View of [offset, offset + size), valid until the next call
+        Skein3::ByteView range(uint64_t offset, size_t size) {
+#ifdef SKEIN3_POSIX_FILES
+            if (region_ && region_->data()) {
+                return Skein3::ByteView(region_->data() + offset, size);
+            }
+#endif
+            buffer_.resize(size);
+            size_t done = 0;
+            while (done < size) {
+#ifdef SKEIN3_POSIX_FILES
+                ssize_t got = ::pread(file_->get(), buffer_.data() + done, size - done,
+                                      static_cast<off_t>(offset + done));
+                if (got < 0 && errno == EINTR) {
+                    continue;
+                }
+#else
+                file_.seekg(static_cast<std::streamoff>(offset + done));
+                file_.read(reinterpret_cast<char*>(buffer_.data() + done),
+                           static_cast<std::streamsize>(size - done));
+                std::streamsize got = file_.gcount();
+                file_.clear();
+#endif
+                if (got <= 0) {
+                    throw std::runtime_error("Could not read file");
+                }
+                done += static_cast<size_t>(got);
+            }
+            return Skein3::ByteView(buffer_);
+        }
+
+    private:
+#ifdef SKEIN3_POSIX_FILES
+        std::unique_ptr<FileDescriptor> file_;
+        std::unique_ptr<MappedRegion> region_;
+#else
+        std::ifstream file_;
+#endif
+        std::vector<uint8_t> buffer_;
+        uint64_t size_ = 0;
+        uint64_t inode_ = 0;
+        uint64_t device_ = 0;
+    };
+
+    // Digest of the parts of [0, offset) that a truncate-and-regrow or a
+    // rewrite changes first: the head and the bytes just before offset
+    std::vector<uint8_t> sample_digest(InputFile& file, uint64_t offset) {
+        Skein3::StreamingHasher hasher(StateWriter::checksum_config());
+        const uint64_t head = std::min<uint64_t>(APPEND_HEAD_BYTES, offset);
+        const uint64_t tail = std::max(head, offset - std::min<uint64_t>(APPEND_TAIL_BYTES, offset));
+        hasher.update(file.range(0, static_cast<size_t>(head)));
+        hasher.update(file.range(tail, static_cast<size_t>(offset - tail)));
+        return StateWriter::seal(hasher, offset);
+    }
+
+    struct AppendState {
+        uint64_t inode;
+        uint64_t device;
+        uint64_t offset;
+        std::vector<uint8_t> sample;
+        std::string checkpoint;
+    };
+
+    AppendState read_append_state(std::istream& in) {
+        StateReader reader(in, "append state");
+        char magic[sizeof(APPEND_STATE_MAGIC)];
+        reader.bytes(magic, sizeof(magic));
+        if (std::memcmp(magic, APPEND_STATE_MAGIC, sizeof(magic)) != 0) {
+            throw std::runtime_error("Not a Skein3 append state");
+        }
+        if (reader.u64() != APPEND_STATE_VERSION) {
+            throw std::runtime_error("Unsupported append state version");
+        }
+        AppendState state;
+        state.inode = reader.u64();
+        state.device = reader.u64();
+        state.offset = reader.u64();
+        reader.bytes(state.sample, SAMPLE_DIGEST_SIZE);
+        std::vector<uint8_t> checkpoint;
+        reader.bytes(checkpoint, reader.u64());
+        state.checkpoint.assign(checkpoint.begin(), checkpoint.end());
+        reader.finish();
+        return state;
+    }
+
+    // Written beside the target and renamed over it, so a crash leaves
+    // either the old state or the new one
+    void write_append_state(const std::string& state_path, const AppendState& state) {
+        const std::string temporary = state_path + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) {
+                throw std::runtime_error("Could not open file for writing");
+            }
+            StateWriter writer(out, "append state");
+            writer.bytes(APPEND_STATE_MAGIC, sizeof(APPEND_STATE_MAGIC));
+            writer.u64(APPEND_STATE_VERSION);
+            writer.u64(state.inode);
+            writer.u64(state.device);
+            writer.u64(state.offset);
+            writer.bytes(state.sample.data(), state.sample.size());
+            writer.u64(state.checkpoint.size());
+            writer.bytes(state.checkpoint.data(), state.checkpoint.size());
+            writer.finish();
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, state_path, error);
+        if (error) {
+            std::filesystem::remove(temporary, error);
+            throw std::runtime_error("Could not write append state");
+        }
+    }
+}
+
+Skein3::AppendHasher::AppendHasher(const Config& config)
+    : config_(config) {
+    // Fail on a bad config or license here rather than on the first file
+    check_hash_config(config);
+}
+
+Skein3::AppendHasher::Result Skein3::AppendHasher::hash(const std::string& path) const {
+    return hash(path, path + ".sk3state");
+}
+
+Skein3::AppendHasher::Result Skein3::AppendHasher::hash(const std::string& path,
+                                                        const std::string& state_path) const {
+    InputFile file(path);
+    Result result;
+    result.status = Status::FULL;
+    std::unique_ptr<FileDigest> hasher;
+    uint64_t offset = 0;
+
+    std::ifstream saved(state_path, std::ios::binary);
+    if (saved.is_open()) {
+        try {
+            AppendState state = read_append_state(saved);
+            result.status = Status::REWRITTEN;
+            if (state.inode == file.inode() && state.device == file.device() &&
+                state.offset <= file.size() && state.sample == sample_digest(file, state.offset)) {
+                std::istringstream checkpoint(state.checkpoint);
+                hasher = std::make_unique<FileDigest>(checkpoint, config_);
+                offset = state.offset;
+                result.status = Status::APPENDED;
+            }
+        } catch (const std::runtime_error&) {
+            // Damaged state, or one saved with another config: start over
+            hasher.reset();
+            result.status = Status::FULL;
+        }
+    }
+    if (!hasher) {
+        hasher = std::make_unique<FileDigest>(config_);
+        offset = 0;
+    }
+
+    const uint64_t size = file.size();
+    for (uint64_t position = offset; position < size; ) {
+        const size_t take = static_cast<size_t>(std::min<uint64_t>(READ_BLOCK_SIZE, size - position));
+        ByteView block = file.range(position, take);
+        hasher->update(block.data, block.size);
+        position += take;
+    }
+    result.size = size;
+    result.bytes_hashed = size - offset;
+
+    // The checkpoint is taken before finalize(), which resets the hasher,
+    // but only written once the digest exists, so a failure leaves the
+    // previous state in place
+    AppendState state;
+    state.inode = file.inode();
+    state.device = file.device();
+    state.offset = size;
+    state.sample = sample_digest(file, size);
+    std::ostringstream checkpoint;
+    hasher->save(checkpoint);
+    state.checkpoint = checkpoint.str();
+
+    result.digest.resize(digest_size(config_));
+    hasher->finalize(result.digest.data());
+    saved.close();
+    write_append_state(state_path, state);
+    return result;
+}
+
+std::vector<uint8_t> Skein3::hash_file(const std::string& path, const Config& config) {
+    std::vector<uint8_t> result(digest_size(config));
+    hash_file(path, result.data(), config);
+    return result;
+}
+
+void Skein3::hash_file(const std::string& path, uint8_t* digest, const Config& config) {
+#ifdef SKEIN3_POSIX_FILES
+    FileDescriptor file(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (file.get() < 0) {
+        throw std::runtime_error("Could not open file for reading");
+    }
+
+    struct stat info;
+    if (::fstat(file.get(), &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0 &&
+        static_cast<uint64_t>(info.st_size) <= SIZE_MAX) {
+        MappedRegion region(file.get(), static_cast<size_t>(info.st_size));
+        if (region.data()) {
+            ByteView contents(region.data(), region.size());
+            if (is_tree(config)) {
+                tree_hash(contents, digest, config);
+            } else {
+                hash(contents, digest, config);
+            }
+            return;
+        }
+    }
+    hash_read_ahead(read_descriptor(file.get()), digest, config);
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file for reading");
+    }
+    hash_read_ahead(read_stream(file), digest, config);
+#endif
+}
+
+std::vector<uint8_t> Skein3::hash_stream(std::istream& in, const Config& config) {
+    std::vector<uint8_t> result(digest_size(config));
+    hash_stream(in, result.data(), config);
+    return result;
+}
+
+void Skein3::hash_stream(std::istream& in, uint8_t* digest, const Config& config) {
+    hash_read_ahead(read_stream(in), digest, config);
+}
+
+std::vector<uint8_t> Skein3::hash_fd(int fd, const Config& config) {
+    std::vector<uint8_t> result(digest_size(config));
+    hash_fd(fd, result.data(), config);
+    return result;
+}
+
+void Skein3::hash_fd(int fd, uint8_t* digest, const Config& config) {
+#ifdef SKEIN3_POSIX_FILES
+    hash_read_ahead(read_descriptor(fd), digest, config);
+#else
+    (void)fd;
+    (void)digest;
+    (void)config;
+    throw std::runtime_error("File descriptors are not supported on this platform");
+#endif
+}
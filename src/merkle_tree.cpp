@@ -0,0 +1,488 @@
+#include "skein3.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Mutable Merkle tree: queued leaf changes, then the union of their paths
+// recomputed level by level. Proofs are read from the cached levels.
+
+namespace {
+    // Parents hashed per pool task
+    constexpr size_t MERKLE_TASK_NODES = 512;
+
+    // Tag of the bound messages at a height: leaves are height 0
+    uint64_t node_tag(size_t height) {
+        return Skein3::MerkleTree::FORMAT_VERSION << 32 | height;
+    }
+
+    void leaf_pointers(const std::vector<Skein3::ByteView>& leaves,
+                       std::vector<const uint8_t*>& data, std::vector<size_t>& sizes) {
+        data.resize(leaves.size());
+        sizes.resize(leaves.size());
+        for (size_t i = 0; i < leaves.size(); ++i) {
+            data[i] = leaves[i].data;
+            sizes[i] = leaves[i].size;
+        }
+    }
+
+    // Siblings in the proof of leaf index among count leaves
+    size_t proof_length(size_t count, size_t index) {
+        size_t length = 0;
+        for (; count > 1; count = (count + 1) / 2, index /= 2) {
+            if ((index ^ 1) < count) {
+                ++length;
+            }
+        }
+        return length;
+    }
+
+    bool strictly_increasing(const std::vector<size_t>& indices) {
+        for (size_t i = 1; i < indices.size(); ++i) {
+            if (indices[i] <= indices[i - 1]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Whether the sibling of known.index[k] is known too
+    bool sibling_known(const std::vector<size_t>& known, size_t k) {
+        if (known[k] % 2 == 0) {
+            return k + 1 < known.size() && known[k + 1] == known[k] + 1;
+        }
+        return k > 0 && known[k - 1] == known[k] - 1;
+    }
+}
+
+Skein3::MerkleTree::MerkleTree(const Config& config)
+    : config_(config)
+    , hash_size_(digest_size(config))
+    , size_(0)
+    , rebuild_(false) {
+    check_hash_config(config);
+    iv_ = initial_chain(config);
+}
+
+Skein3::MerkleTree::MerkleTree(const std::vector<ByteView>& leaves, const Config& config)
+    : MerkleTree(config) {
+    size_ = leaves.size();
+    levels_.emplace_back(size_ * hash_size_);
+    std::vector<const uint8_t*> data;
+    std::vector<size_t> sizes;
+    leaf_pointers(leaves, data, sizes);
+    hash_bound(iv_, data.data(), sizes.data(), size_, node_tag(0), hash_size_,
+               levels_[0].data());
+    rebuild_ = true;
+}
+
+void Skein3::MerkleTree::update(size_t index, ByteView leaf) {
+    if (index >= size_) {
+        throw std::out_of_range("Leaf index out of range");
+    }
+    changes_.push_back({index, change_bytes_.size(), leaf.size});
+    change_bytes_.insert(change_bytes_.end(), leaf.data, leaf.data + leaf.size);
+}
+
+void Skein3::MerkleTree::append(ByteView leaf) {
+    changes_.push_back({size_, change_bytes_.size(), leaf.size});
+    change_bytes_.insert(change_bytes_.end(), leaf.data, leaf.data + leaf.size);
+    ++size_;
+}
+
+std::vector<uint8_t> Skein3::MerkleTree::root() {
+    std::vector<uint8_t> result(hash_size_);
+    root(result.data());
+    return result;
+}
+
+void Skein3::MerkleTree::root(uint8_t* digest) {
+    flush();
+    std::memcpy(digest, levels_.back().data(), hash_size_);
+}
+
+void Skein3::MerkleTree::flush() {
+    if (size_ == 0) {
+        throw std::invalid_argument("Empty transaction list");
+    }
+    const size_t hash_size = hash_size_;
+    if (levels_.empty()) {
+        levels_.emplace_back();
+    }
+    levels_[0].resize(size_ * hash_size);
+
+    // Queued leaves go through the multi-buffer engine in one batch, then
+    // land in queue order so the last change to a leaf wins
+    std::vector<size_t> dirty;
+    if (!changes_.empty()) {
+        const size_t count = changes_.size();
+        std::vector<const uint8_t*> leaves(count);
+        std::vector<size_t> sizes(count);
+        for (size_t i = 0; i < count; ++i) {
+            leaves[i] = change_bytes_.data() + changes_[i].offset;
+            sizes[i] = changes_[i].size;
+        }
+        std::vector<uint8_t> digests(count * hash_size);
+        hash_bound(iv_, leaves.data(), sizes.data(), count, node_tag(0), hash_size,
+                   digests.data());
+        for (size_t i = 0; i < count; ++i) {
+            std::memcpy(levels_[0].data() + changes_[i].index * hash_size,
+                        digests.data() + i * hash_size, hash_size);
+        }
+
+        if (!rebuild_) {
+            dirty.reserve(count);
+            for (const Change& change : changes_) {
+                dirty.push_back(change.index);
+            }
+            std::sort(dirty.begin(), dirty.end());
+            dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+        }
+        changes_.clear();
+        change_bytes_.clear();
+    }
+
+    ThreadPool& pool = ThreadPool::shared();
+    const size_t pair = 2 * hash_size;
+    size_t count = size_;
+    size_t height = 0;
+    while (count > 1) {
+        ++height;
+        const size_t num_parents = (count + 1) / 2;
+        if (levels_.size() <= height) {
+            levels_.emplace_back();
+        }
+        levels_[height].resize(num_parents * hash_size);
+        const uint8_t* children = levels_[height - 1].data();
+        uint8_t* parents = levels_[height].data();
+
+        // All parents on a rebuild, else those of the dirty children;
+        // the list stays sorted and unique
+        if (rebuild_) {
+            dirty.resize(num_parents);
+            for (size_t parent = 0; parent < num_parents; ++parent) {
+                dirty[parent] = parent;
+            }
+        } else {
+            size_t kept = 0;
+            for (size_t child : dirty) {
+                if (kept == 0 || dirty[kept - 1] != child / 2) {
+                    dirty[kept++] = child / 2;
+                }
+            }
+            dirty.resize(kept);
+        }
+
+        // Each task gathers its sibling pairs, hashes them in one
+        // multi-buffer batch and writes only its own parents
+        const size_t tasks = (dirty.size() + MERKLE_TASK_NODES - 1) / MERKLE_TASK_NODES;
+        pool.parallel_for(tasks, [&](size_t t) {
+            const size_t first = t * MERKLE_TASK_NODES;
+            const size_t nodes = std::min(MERKLE_TASK_NODES, dirty.size() - first);
+            std::array<const uint8_t*, MERKLE_TASK_NODES> pairs;
+            std::array<size_t, MERKLE_TASK_NODES> sizes;
+            std::vector<uint8_t> digests(nodes * hash_size);
+            for (size_t i = 0; i < nodes; ++i) {
+                const size_t parent = dirty[first + i];
+                pairs[i] = children + parent * pair;
+                sizes[i] = std::min<size_t>(2, count - 2 * parent) * hash_size;
+            }
+            ubi_bound(iv_, pairs.data(), sizes.data(), nodes, node_tag(height), hash_size,
+                      digests.data());
+            for (size_t i = 0; i < nodes; ++i) {
+                std::memcpy(parents + dirty[first + i] * hash_size,
+                            digests.data() + i * hash_size, hash_size);
+            }
+        });
+        count = num_parents;
+    }
+    levels_.resize(height + 1);
+    rebuild_ = false;
+}
+
+void Skein3::MerkleTree::check_applied() const {
+    if (!changes_.empty() || rebuild_) {
+        throw std::runtime_error("Merkle tree has changes not applied by root()");
+    }
+}
+
+std::vector<uint8_t> Skein3::MerkleTree::proof(size_t index) const {
+    check_applied();
+    if (index >= size_) {
+        throw std::out_of_range("Leaf index out of range");
+    }
+    const size_t hash_size = hash_size_;
+    std::vector<uint8_t> result(proof_length(size_, index) * hash_size);
+    uint8_t* out = result.data();
+    size_t count = size_;
+    for (size_t height = 0; count > 1; ++height, count = (count + 1) / 2, index /= 2) {
+        if ((index ^ 1) < count) {
+            std::memcpy(out, levels_[height].data() + (index ^ 1) * hash_size, hash_size);
+            out += hash_size;
+        }
+    }
+    return result;
+}
+
+std::vector<uint8_t> Skein3::MerkleTree::multiproof(const std::vector<size_t>& indices) const {
+    check_applied();
+    if (indices.empty() || !strictly_increasing(indices)) {
+        throw std::invalid_argument("Leaf indices must be strictly increasing");
+    }
+    if (indices.back() >= size_) {
+        throw std::out_of_range("Leaf index out of range");
+    }
+
+    const size_t hash_size = hash_size_;
+    std::vector<uint8_t> result;
+    std::vector<size_t> known = indices;
+    size_t count = size_;
+    for (size_t height = 0; count > 1; ++height) {
+        const uint8_t* level = levels_[height].data();
+        size_t kept = 0;
+        for (size_t k = 0; k < known.size(); ++k) {
+            const size_t sibling = known[k] ^ 1;
+            if (sibling < count && !sibling_known(known, k)) {
+                result.insert(result.end(), level + sibling * hash_size,
+                              level + (sibling + 1) * hash_size);
+            }
+        }
+        for (size_t node : known) {
+            if (kept == 0 || known[kept - 1] != node / 2) {
+                known[kept++] = node / 2;
+            }
+        }
+        known.resize(kept);
+        count = (count + 1) / 2;
+    }
+    return result;
+}
+
+bool Skein3::MerkleTree::hash_parents(const std::array<uint64_t, Threefish3::NUM_WORDS>& iv,
+                                      size_t hash_size, size_t height, size_t count,
+                                      const Nodes& known, const Nodes& siblings,
+                                      Nodes& parents) {
+    const size_t pair = 2 * hash_size;
+    parents.index.clear();
+    for (size_t child : known.index) {
+        if (parents.index.empty() || parents.index.back() != child / 2) {
+            parents.index.push_back(child / 2);
+        }
+    }
+
+    // Both lists are sorted, so the children of increasing parents are
+    // found by walking them once; each pair is copied into one message
+    const size_t num_parents = parents.index.size();
+    std::vector<uint8_t> messages(num_parents * pair);
+    std::vector<size_t> sizes(num_parents);
+    size_t next_known = 0;
+    size_t next_sibling = 0;
+    for (size_t i = 0; i < num_parents; ++i) {
+        const size_t first = 2 * parents.index[i];
+        const size_t children = std::min<size_t>(2, count - first);
+        for (size_t c = 0; c < children; ++c) {
+            const uint8_t* digest;
+            if (next_known < known.index.size() && known.index[next_known] == first + c) {
+                digest = known.digests.data() + next_known++ * hash_size;
+            } else if (next_sibling < siblings.index.size() &&
+                       siblings.index[next_sibling] == first + c) {
+                digest = siblings.digests.data() + next_sibling++ * hash_size;
+            } else {
+                return false;
+            }
+            std::memcpy(messages.data() + i * pair + c * hash_size, digest, hash_size);
+        }
+        sizes[i] = children * hash_size;
+    }
+    if (next_sibling != siblings.index.size()) {
+        return false;
+    }
+
+    parents.digests.resize(num_parents * hash_size);
+    auto run = [&](size_t t) {
+        const size_t first = t * MERKLE_TASK_NODES;
+        const size_t nodes = std::min(MERKLE_TASK_NODES, num_parents - first);
+        std::array<const uint8_t*, MERKLE_TASK_NODES> pairs;
+        for (size_t i = 0; i < nodes; ++i) {
+            pairs[i] = messages.data() + (first + i) * pair;
+        }
+        ubi_bound(iv, pairs.data(), sizes.data() + first, nodes, node_tag(height + 1),
+                  hash_size, parents.digests.data() + first * hash_size);
+    };
+    const size_t tasks = (num_parents + MERKLE_TASK_NODES - 1) / MERKLE_TASK_NODES;
+    if (tasks == 1) {
+        run(0);
+    } else {
+        ThreadPool::shared().parallel_for(tasks, run);
+    }
+    return true;
+}
+
+bool Skein3::MerkleTree::verify_proof(ByteView root, size_t count, size_t index, ByteView leaf,
+                                      ByteView proof, const Config& config) {
+    check_hash_config(config);
+    const size_t hash_size = digest_size(config);
+    if (root.size != hash_size || index >= count ||
+        proof.size != proof_length(count, index) * hash_size) {
+        return false;
+    }
+
+    // pair holds the node and its sibling in tree order
+    const auto iv = initial_chain(config);
+    uint8_t pair[2 * Threefish3::BLOCK_SIZE];
+    uint8_t node[Threefish3::BLOCK_SIZE];
+    ubi_bound(iv, &leaf.data, &leaf.size, 1, node_tag(0), hash_size, node);
+    const uint8_t* sibling = proof.data;
+    for (size_t height = 1; count > 1; ++height, count = (count + 1) / 2, index /= 2) {
+        size_t size = hash_size;
+        if ((index ^ 1) < count) {
+            std::memcpy(pair + (index % 2) * hash_size, node, hash_size);
+            std::memcpy(pair + (1 - index % 2) * hash_size, sibling, hash_size);
+            sibling += hash_size;
+            size = 2 * hash_size;
+        } else {
+            std::memcpy(pair, node, hash_size);
+        }
+        const uint8_t* message = pair;
+        ubi_bound(iv, &message, &size, 1, node_tag(height), hash_size, node);
+    }
+    return std::memcmp(node, root.data, hash_size) == 0;
+}
+
+bool Skein3::MerkleTree::verify_multiproof(ByteView root, size_t count,
+                                           const std::vector<size_t>& indices,
+                                           const std::vector<ByteView>& leaves,
+                                           ByteView proof, const Config& config) {
+    check_hash_config(config);
+    const size_t hash_size = digest_size(config);
+    if (root.size != hash_size || indices.empty() || leaves.size() != indices.size() ||
+        !strictly_increasing(indices) || indices.back() >= count ||
+        proof.size % hash_size != 0) {
+        return false;
+    }
+
+    const auto iv = initial_chain(config);
+    Nodes known;
+    known.index = indices;
+    known.digests.resize(indices.size() * hash_size);
+    std::vector<const uint8_t*> data;
+    std::vector<size_t> sizes;
+    leaf_pointers(leaves, data, sizes);
+    hash_bound(iv, data.data(), sizes.data(), leaves.size(), node_tag(0), hash_size,
+               known.digests.data());
+
+    // Siblings come out of the proof in the order multiproof() wrote them
+    const uint8_t* next = proof.data;
+    const uint8_t* const end = proof.data + proof.size;
+    Nodes siblings;
+    Nodes parents;
+    for (size_t height = 0; count > 1; ++height, count = (count + 1) / 2) {
+        siblings.index.clear();
+        siblings.digests.clear();
+        for (size_t k = 0; k < known.index.size(); ++k) {
+            const size_t sibling = known.index[k] ^ 1;
+            if (sibling < count && !sibling_known(known.index, k)) {
+                if (next == end) {
+                    return false;
+                }
+                siblings.index.push_back(sibling);
+                siblings.digests.insert(siblings.digests.end(), next, next + hash_size);
+                next += hash_size;
+            }
+        }
+        if (!hash_parents(iv, hash_size, height, count, known, siblings, parents)) {
+            return false;
+        }
+        std::swap(known, parents);
+    }
+    return next == end && std::memcmp(known.digests.data(), root.data, hash_size) == 0;
+}
+
+bool Skein3::MerkleTree::verify_proofs(ByteView root, size_t count,
+                                       const std::vector<size_t>& indices,
+                                       const std::vector<ByteView>& leaves,
+                                       const std::vector<ByteView>& proofs,
+                                       const Config& config) {
+    check_hash_config(config);
+    const size_t hash_size = digest_size(config);
+    const size_t num_proofs = indices.size();
+    if (root.size != hash_size || num_proofs == 0 || leaves.size() != num_proofs ||
+        proofs.size() != num_proofs) {
+        return false;
+    }
+    for (size_t i = 0; i < num_proofs; ++i) {
+        if (indices[i] >= count ||
+            proofs[i].size != proof_length(count, indices[i]) * hash_size) {
+            return false;
+        }
+    }
+
+    const auto iv = initial_chain(config);
+    std::vector<uint8_t> leaf_digests(num_proofs * hash_size);
+    std::vector<const uint8_t*> data;
+    std::vector<size_t> sizes;
+    leaf_pointers(leaves, data, sizes);
+    hash_bound(iv, data.data(), sizes.data(), num_proofs, node_tag(0), hash_size,
+               leaf_digests.data());
+
+    // Proofs are walked in leaf order, so at every level their nodes and
+    // siblings come out sorted and equal ones are adjacent
+    std::vector<size_t> order(num_proofs);
+    for (size_t i = 0; i < num_proofs; ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(),
+              [&](size_t a, size_t b) { return indices[a] < indices[b]; });
+
+    // Proofs for the same leaf must agree on it
+    Nodes known;
+    for (size_t i : order) {
+        const uint8_t* digest = leaf_digests.data() + i * hash_size;
+        if (!known.index.empty() && known.index.back() == indices[i]) {
+            if (std::memcmp(known.digests.data() + known.digests.size() - hash_size,
+                            digest, hash_size) != 0) {
+                return false;
+            }
+            continue;
+        }
+        known.index.push_back(indices[i]);
+        known.digests.insert(known.digests.end(), digest, digest + hash_size);
+    }
+
+    // A sibling that another path computes is checked against it, and
+    // proofs that supply the same sibling must agree
+    Nodes siblings;
+    Nodes parents;
+    std::vector<size_t> used(num_proofs, 0);
+    for (size_t height = 0; count > 1; ++height, count = (count + 1) / 2) {
+        siblings.index.clear();
+        siblings.digests.clear();
+        for (size_t i : order) {
+            const size_t sibling = (indices[i] >> height) ^ 1;
+            if (sibling >= count) {
+                continue;
+            }
+            const uint8_t* digest = proofs[i].data + used[i];
+            used[i] += hash_size;
+            const auto computed = std::lower_bound(known.index.begin(), known.index.end(),
+                                                   sibling);
+            const uint8_t* expected = nullptr;
+            if (computed != known.index.end() && *computed == sibling) {
+                expected = known.digests.data() + (computed - known.index.begin()) * hash_size;
+            } else if (!siblings.index.empty() && siblings.index.back() == sibling) {
+                expected = siblings.digests.data() + siblings.digests.size() - hash_size;
+            }
+            if (expected == nullptr) {
+                siblings.index.push_back(sibling);
+                siblings.digests.insert(siblings.digests.end(), digest, digest + hash_size);
+            } else if (std::memcmp(expected, digest, hash_size) != 0) {
+                return false;
+            }
+        }
+        if (!hash_parents(iv, hash_size, height, count, known, siblings, parents)) {
+            return false;
+        }
+        std::swap(known, parents);
+    }
+    return std::memcmp(known.digests.data(), root.data, hash_size) == 0;
+}
@@ -0,0 +1,518 @@
+#include "skein3.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+// Merkle Mountain Range: perfect trees in post-order, peaks bagged into
+// the root, proofs as flat digest lists
+
+namespace {
+    constexpr char MMR_MAGIC[8] = {'S', 'K', '3', 'M', 'M', 'R', 'N', 'D'};
+    constexpr uint64_t MMR_VERSION = 2;
+    constexpr size_t MMR_FINGERPRINT = 32;
+    // Magic, version, hash size and fingerprint, then the nodes
+    constexpr size_t MMR_HEADER = 8 + 8 + 8 + MMR_FINGERPRINT;
+
+    // Both children fill the first block, the height is the final block
+    constexpr size_t NODE_MESSAGE = Threefish3::BLOCK_SIZE + 8;
+    // Leaves go through ubi_bound with this tag; version 1 used plain hash()
+    constexpr uint64_t LEAF_TAG = MMR_VERSION << 32;
+    constexpr size_t MMR_TASK_NODES = 512;
+
+    struct Mountain {
+        uint64_t start;   // first leaf
+        size_t height;
+    };
+
+    uint64_t popcount(uint64_t value) {
+        return std::bitset<64>(value).count();
+    }
+
+    // Nodes of a range with this many leaves
+    uint64_t node_count(uint64_t leaves) {
+        return 2 * leaves - popcount(leaves);
+    }
+
+    // Post-order position of the node over leaves [start, start + 2^height);
+    // mountains are aligned, so this holds across the whole range
+    uint64_t node_position(uint64_t start, size_t height) {
+        const uint64_t last = start + (uint64_t(1) << height) - 1;
+        return 2 * last - popcount(last) + height;
+    }
+
+    // Mountains from left (tallest) to right
+    std::vector<Mountain> mountains(uint64_t leaves) {
+        std::vector<Mountain> result;
+        uint64_t start = 0;
+        for (size_t height = 64; height-- > 0; ) {
+            if (leaves & (uint64_t(1) << height)) {
+                result.push_back({start, height});
+                start += uint64_t(1) << height;
+            }
+        }
+        return result;
+    }
+
+    void put_u64(uint8_t* out, uint64_t value) {
+        for (size_t i = 0; i < 8; ++i) {
+            out[i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+
+    void node_message(uint8_t* message, const uint8_t* left, const uint8_t* right,
+                      size_t hash_size, uint64_t height) {
+        std::memset(message, 0, NODE_MESSAGE);
+        std::memcpy(message, left, hash_size);
+        std::memcpy(message + hash_size, right, hash_size);
+        put_u64(message + Threefish3::BLOCK_SIZE, height);
+    }
+
+    void mmr_header(uint8_t* header, size_t hash_size, const uint64_t* fingerprint) {
+        std::memcpy(header, MMR_MAGIC, sizeof(MMR_MAGIC));
+        put_u64(header + 8, MMR_VERSION);
+        put_u64(header + 16, hash_size);
+        std::memcpy(header + 24, fingerprint, MMR_FINGERPRINT);
+    }
+}
+
+Skein3::MerkleMountainRange::MerkleMountainRange(const Config& config)
+    : config_(config)
+    , hash_size_(digest_size(config))
+    , size_(0)
+    , node_count_(0) {
+    check_hash_config(config);
+    iv_ = initial_chain(config);
+}
+
+Skein3::MerkleMountainRange::MerkleMountainRange(const std::string& node_file,
+                                                 const Config& config)
+    : MerkleMountainRange(config) {
+    uint8_t expected[MMR_HEADER];
+    mmr_header(expected, hash_size_, iv_.data());
+
+    std::error_code error;
+    if (!std::filesystem::exists(node_file, error)) {
+        std::ofstream create(node_file, std::ios::binary);
+        create.write(reinterpret_cast<const char*>(expected), sizeof(expected));
+        if (!create) {
+            throw std::runtime_error("Could not create node file");
+        }
+    }
+
+    {
+        std::ifstream in(node_file, std::ios::binary);
+        uint8_t header[MMR_HEADER];
+        in.read(reinterpret_cast<char*>(header), sizeof(header));
+        if (static_cast<size_t>(in.gcount()) != sizeof(header) ||
+            std::memcmp(header, MMR_MAGIC, sizeof(MMR_MAGIC)) != 0) {
+            throw std::runtime_error("Not a Skein3 mountain range");
+        }
+        if (std::memcmp(header, expected, sizeof(header)) != 0) {
+            throw std::runtime_error("Node file was written with a different config");
+        }
+    }
+
+    // Keep the longest prefix that holds whole appends; a crash can leave
+    // part of a batch behind
+    const uint64_t stored = (std::filesystem::file_size(node_file) - MMR_HEADER) / hash_size_;
+    uint64_t leaves = (stored + 64) / 2;
+    while (leaves > 0 && node_count(leaves) > stored) {
+        --leaves;
+    }
+    const uint64_t kept = MMR_HEADER + node_count(leaves) * hash_size_;
+    if (std::filesystem::file_size(node_file) != kept) {
+        std::filesystem::resize_file(node_file, kept);
+    }
+
+    file_ = std::make_unique<std::fstream>(node_file,
+                                           std::ios::in | std::ios::out | std::ios::binary);
+    if (!file_->is_open()) {
+        throw std::runtime_error("Could not open node file");
+    }
+    size_ = leaves;
+    node_count_ = node_count(leaves);
+    for (const Mountain& mountain : mountains(size_)) {
+        peaks_.resize(peaks_.size() + hash_size_);
+        read_node(node_position(mountain.start, mountain.height),
+                  peaks_.data() + peaks_.size() - hash_size_);
+    }
+}
+
+Skein3::MerkleMountainRange::MerkleMountainRange(MerkleMountainRange&&) noexcept = default;
+Skein3::MerkleMountainRange& Skein3::MerkleMountainRange::operator=(
+    MerkleMountainRange&&) noexcept = default;
+Skein3::MerkleMountainRange::~MerkleMountainRange() = default;
+
+uint64_t Skein3::MerkleMountainRange::append(ByteView leaf) {
+    // The new leaf merges with one peak per trailing one bit of the size
+    const size_t hash_size = hash_size_;
+    size_t merges = 0;
+    while ((size_ >> merges) & 1) {
+        ++merges;
+    }
+    std::vector<uint8_t> nodes((merges + 1) * hash_size);
+    ubi_bound(iv_, &leaf.data, &leaf.size, 1, LEAF_TAG, hash_size, nodes.data());
+    for (size_t height = 0; height < merges; ++height) {
+        const uint8_t* left = peaks_.data() + peaks_.size() - (height + 1) * hash_size;
+        hash_node(iv_, hash_size, left, nodes.data() + height * hash_size, height + 1,
+                  nodes.data() + (height + 1) * hash_size);
+    }
+
+    write_nodes(node_count_, nodes.data(), merges + 1);
+    peaks_.resize(peaks_.size() - merges * hash_size);
+    peaks_.insert(peaks_.end(), nodes.end() - hash_size, nodes.end());
+    node_count_ += merges + 1;
+    return size_++;
+}
+
+void Skein3::MerkleMountainRange::append(const std::vector<ByteView>& leaves) {
+    if (leaves.empty()) {
+        return;
+    }
+    const size_t hash_size = hash_size_;
+
+    // Lay out the new nodes in post-order before hashing anything. Digests
+    // go in one table: the old peaks first, then the new nodes.
+    struct Job {
+        size_t left;
+        size_t right;
+        size_t parent;
+    };
+    struct Peak {
+        size_t slot;
+        size_t height;
+    };
+    const size_t old_peaks = peaks_.size() / hash_size;
+    std::vector<Peak> stack;
+    for (const Mountain& mountain : mountains(size_)) {
+        stack.push_back({stack.size(), mountain.height});
+    }
+    std::vector<size_t> leaf_slots(leaves.size());
+    std::vector<std::vector<Job>> jobs;  // jobs[h] make parents at height h + 1
+    size_t added = 0;
+    for (size_t i = 0; i < leaves.size(); ++i) {
+        leaf_slots[i] = old_peaks + added++;
+        stack.push_back({leaf_slots[i], 0});
+        while (stack.size() >= 2 && stack.back().height == stack[stack.size() - 2].height) {
+            const Peak right = stack.back();
+            stack.pop_back();
+            const Peak left = stack.back();
+            stack.pop_back();
+            if (jobs.size() <= left.height) {
+                jobs.resize(left.height + 1);
+            }
+            jobs[left.height].push_back({left.slot, right.slot, old_peaks + added});
+            stack.push_back({old_peaks + added++, left.height + 1});
+        }
+    }
+
+    std::vector<uint8_t> table((old_peaks + added) * hash_size);
+    std::memcpy(table.data(), peaks_.data(), peaks_.size());
+    std::vector<const uint8_t*> leaf_data(leaves.size());
+    std::vector<size_t> leaf_sizes(leaves.size());
+    for (size_t i = 0; i < leaves.size(); ++i) {
+        leaf_data[i] = leaves[i].data;
+        leaf_sizes[i] = leaves[i].size;
+    }
+    std::vector<uint8_t> digests(leaves.size() * hash_size);
+    hash_bound(iv_, leaf_data.data(), leaf_sizes.data(), leaves.size(), LEAF_TAG, hash_size,
+               digests.data());
+    for (size_t i = 0; i < leaves.size(); ++i) {
+        std::memcpy(table.data() + leaf_slots[i] * hash_size,
+                    digests.data() + i * hash_size, hash_size);
+    }
+
+    // Parents of one height depend only on lower heights, so each height
+    // is a single multi-buffer batch
+    std::vector<uint8_t> messages;
+    for (size_t height = 0; height < jobs.size(); ++height) {
+        const std::vector<Job>& level = jobs[height];
+        messages.resize(level.size() * NODE_MESSAGE);
+        digests.resize(level.size() * hash_size);
+        for (size_t i = 0; i < level.size(); ++i) {
+            node_message(messages.data() + i * NODE_MESSAGE,
+                         table.data() + level[i].left * hash_size,
+                         table.data() + level[i].right * hash_size, hash_size, height + 1);
+        }
+        hash_nodes(iv_, hash_size, messages.data(), level.size(), digests.data());
+        for (size_t i = 0; i < level.size(); ++i) {
+            std::memcpy(table.data() + level[i].parent * hash_size,
+                        digests.data() + i * hash_size, hash_size);
+        }
+    }
+
+    write_nodes(node_count_, table.data() + old_peaks * hash_size, added);
+    peaks_.resize(stack.size() * hash_size);
+    for (size_t i = 0; i < stack.size(); ++i) {
+        std::memcpy(peaks_.data() + i * hash_size,
+                    table.data() + stack[i].slot * hash_size, hash_size);
+    }
+    size_ += leaves.size();
+    node_count_ += added;
+}
+
+std::vector<uint8_t> Skein3::MerkleMountainRange::root() const {
+    std::vector<uint8_t> result(hash_size_);
+    root(result.data());
+    return result;
+}
+
+void Skein3::MerkleMountainRange::root(uint8_t* digest) const {
+    if (size_ == 0) {
+        throw std::invalid_argument("Empty transaction list");
+    }
+    bag_peaks(iv_, hash_size_, peaks_.data(), peaks_.size() / hash_size_, digest);
+}
+
+std::vector<uint8_t> Skein3::MerkleMountainRange::inclusion_proof(uint64_t index) const {
+    if (index >= size_) {
+        throw std::out_of_range("Leaf index out of range");
+    }
+    const size_t hash_size = hash_size_;
+    const std::vector<Mountain> peaks = mountains(size_);
+    size_t mountain = 0;
+    while (index >= peaks[mountain].start + (uint64_t(1) << peaks[mountain].height)) {
+        ++mountain;
+    }
+
+    // Siblings from the leaf up to its peak, then the other peaks
+    const size_t height = peaks[mountain].height;
+    std::vector<uint8_t> proof((height + peaks.size() - 1) * hash_size);
+    for (size_t t = 0; t < height; ++t) {
+        const uint64_t sibling = ((index >> t) ^ 1) << t;
+        read_node(node_position(sibling, t), proof.data() + t * hash_size);
+    }
+    uint8_t* out = proof.data() + height * hash_size;
+    for (size_t i = 0; i < peaks.size(); ++i) {
+        if (i != mountain) {
+            std::memcpy(out, peaks_.data() + i * hash_size, hash_size);
+            out += hash_size;
+        }
+    }
+    return proof;
+}
+
+std::vector<uint8_t> Skein3::MerkleMountainRange::consistency_proof(uint64_t old_size) const {
+    if (old_size == 0 || old_size > size_) {
+        throw std::out_of_range("Old size out of range");
+    }
+    const size_t hash_size = hash_size_;
+    const std::vector<Mountain> old_peaks = mountains(old_size);
+    const std::vector<Mountain> new_peaks = mountains(size_);
+
+    std::vector<uint8_t> proof;
+    auto emit = [&](uint64_t position) {
+        proof.resize(proof.size() + hash_size);
+        read_node(position, proof.data() + proof.size() - hash_size);
+    };
+
+    // Old peaks are nodes of the new range, so they are read in place
+    for (const Mountain& peak : old_peaks) {
+        emit(node_position(peak.start, peak.height));
+    }
+    for (size_t i = 0; i < new_peaks.size(); ++i) {
+        const Mountain& peak = new_peaks[i];
+        const uint64_t end = peak.start + (uint64_t(1) << peak.height);
+        if (end <= old_size) {
+            continue;  // an old peak, unchanged
+        }
+        if (peak.start >= old_size) {
+            proof.insert(proof.end(), peaks_.begin() + i * hash_size,
+                         peaks_.begin() + (i + 1) * hash_size);
+            continue;
+        }
+        // Climb from the smallest old peak; right siblings are new nodes,
+        // left siblings are the old peaks the verifier already has
+        uint64_t start = old_peaks.back().start;
+        for (size_t t = old_peaks.back().height; t < peak.height; ++t) {
+            if ((((start - peak.start) >> t) & 1) == 0) {
+                emit(node_position(start + (uint64_t(1) << t), t));
+            } else {
+                start -= uint64_t(1) << t;
+            }
+        }
+    }
+    return proof;
+}
+
+bool Skein3::MerkleMountainRange::verify_inclusion(ByteView root, uint64_t size, uint64_t index,
+                                                   ByteView leaf, ByteView proof,
+                                                   const Config& config) {
+    check_hash_config(config);
+    const size_t hash_size = digest_size(config);
+    if (root.size != hash_size || index >= size) {
+        return false;
+    }
+    const std::vector<Mountain> peaks = mountains(size);
+    size_t mountain = 0;
+    while (index >= peaks[mountain].start + (uint64_t(1) << peaks[mountain].height)) {
+        ++mountain;
+    }
+    const size_t height = peaks[mountain].height;
+    if (proof.size != (height + peaks.size() - 1) * hash_size) {
+        return false;
+    }
+
+    const Chain iv = initial_chain(config);
+    std::vector<uint8_t> all_peaks(peaks.size() * hash_size);
+    uint8_t* node = all_peaks.data() + mountain * hash_size;
+    ubi_bound(iv, &leaf.data, &leaf.size, 1, LEAF_TAG, hash_size, node);
+    for (size_t t = 0; t < height; ++t) {
+        const uint8_t* sibling = proof.data + t * hash_size;
+        if (((index >> t) & 1) == 0) {
+            hash_node(iv, hash_size, node, sibling, t + 1, node);
+        } else {
+            hash_node(iv, hash_size, sibling, node, t + 1, node);
+        }
+    }
+    const uint8_t* others = proof.data + height * hash_size;
+    for (size_t i = 0; i < peaks.size(); ++i) {
+        if (i != mountain) {
+            std::memcpy(all_peaks.data() + i * hash_size, others, hash_size);
+            others += hash_size;
+        }
+    }
+
+    uint8_t digest[Threefish3::BLOCK_SIZE];
+    bag_peaks(iv, hash_size, all_peaks.data(), peaks.size(), digest);
+    return std::memcmp(digest, root.data, hash_size) == 0;
+}
+
+bool Skein3::MerkleMountainRange::verify_consistency(ByteView old_root, uint64_t old_size,
+                                                     ByteView new_root, uint64_t new_size,
+                                                     ByteView proof, const Config& config) {
+    check_hash_config(config);
+    const size_t hash_size = digest_size(config);
+    if (old_root.size != hash_size || new_root.size != hash_size ||
+        old_size == 0 || old_size > new_size) {
+        return false;
+    }
+    const std::vector<Mountain> old_peaks = mountains(old_size);
+    const std::vector<Mountain> new_peaks = mountains(new_size);
+    if (proof.size < old_peaks.size() * hash_size || proof.size % hash_size != 0) {
+        return false;
+    }
+
+    const Chain iv = initial_chain(config);
+    uint8_t digest[Threefish3::BLOCK_SIZE];
+    bag_peaks(iv, hash_size, proof.data, old_peaks.size(), digest);
+    if (std::memcmp(digest, old_root.data, hash_size) != 0) {
+        return false;
+    }
+
+    const uint8_t* next = proof.data + old_peaks.size() * hash_size;
+    const uint8_t* const end = proof.data + proof.size;
+    std::vector<uint8_t> peaks(new_peaks.size() * hash_size);
+    size_t old_index = 0;
+    for (size_t i = 0; i < new_peaks.size(); ++i) {
+        const Mountain& peak = new_peaks[i];
+        uint8_t* out = peaks.data() + i * hash_size;
+        if (peak.start + (uint64_t(1) << peak.height) <= old_size) {
+            // Mountains entirely below old_size are the old peaks themselves
+            std::memcpy(out, proof.data + old_index++ * hash_size, hash_size);
+            continue;
+        }
+        if (peak.start >= old_size) {
+            if (next == end) {
+                return false;
+            }
+            std::memcpy(out, next, hash_size);
+            next += hash_size;
+            continue;
+        }
+
+        size_t left = old_peaks.size() - 1;
+        std::memcpy(out, proof.data + left * hash_size, hash_size);
+        uint64_t start = old_peaks[left].start;
+        for (size_t t = old_peaks[left].height; t < peak.height; ++t) {
+            if ((((start - peak.start) >> t) & 1) == 0) {
+                if (next == end) {
+                    return false;
+                }
+                hash_node(iv, hash_size, out, next, t + 1, out);
+                next += hash_size;
+            } else {
+                // The left sibling is the next old peak to the left
+                --left;
+                hash_node(iv, hash_size, proof.data + left * hash_size, out, t + 1, out);
+                start -= uint64_t(1) << t;
+            }
+        }
+        old_index = old_peaks.size();
+    }
+    if (next != end) {
+        return false;
+    }
+
+    bag_peaks(iv, hash_size, peaks.data(), new_peaks.size(), digest);
+    return std::memcmp(digest, new_root.data, hash_size) == 0;
+}
+
+void Skein3::MerkleMountainRange::hash_nodes(const Chain& iv, size_t hash_size,
+                                             const uint8_t* messages, size_t count,
+                                             uint8_t* digests) {
+    const size_t tasks = (count + MMR_TASK_NODES - 1) / MMR_TASK_NODES;
+    auto run = [&](size_t t) {
+        const size_t first = t * MMR_TASK_NODES;
+        const size_t nodes = std::min(MMR_TASK_NODES, count - first);
+        hash_pieces(iv, messages + first * NODE_MESSAGE, nodes * NODE_MESSAGE, NODE_MESSAGE,
+                    hash_size, digests + first * hash_size);
+    };
+    if (tasks == 1) {
+        run(0);
+    } else {
+        ThreadPool::shared().parallel_for(tasks, run);
+    }
+}
+
+void Skein3::MerkleMountainRange::hash_node(const Chain& iv, size_t hash_size,
+                                            const uint8_t* left, const uint8_t* right,
+                                            uint64_t height, uint8_t* digest) {
+    // The message is built first, so digest may alias left or right
+    uint8_t message[NODE_MESSAGE];
+    node_message(message, left, right, hash_size, height);
+    hash_pieces(iv, message, NODE_MESSAGE, NODE_MESSAGE, hash_size, digest);
+}
+
+void Skein3::MerkleMountainRange::bag_peaks(const Chain& iv, size_t hash_size,
+                                            const uint8_t* peaks, size_t count,
+                                            uint8_t* digest) {
+    std::memcpy(digest, peaks + (count - 1) * hash_size, hash_size);
+    for (size_t i = count - 1; i-- > 0; ) {
+        hash_node(iv, hash_size, peaks + i * hash_size, digest, 0, digest);
+    }
+}
+
+void Skein3::MerkleMountainRange::read_node(uint64_t position, uint8_t* digest) const {
+    if (!file_) {
+        std::memcpy(digest, nodes_.data() + position * hash_size_, hash_size_);
+        return;
+    }
+    file_->clear();
+    file_->seekg(static_cast<std::streamoff>(MMR_HEADER + position * hash_size_));
+    file_->read(reinterpret_cast<char*>(digest), static_cast<std::streamsize>(hash_size_));
+    if (static_cast<size_t>(file_->gcount()) != hash_size_) {
+        throw std::runtime_error("Could not read node file");
+    }
+}
+
+void Skein3::MerkleMountainRange::write_nodes(uint64_t position, const uint8_t* digests,
+                                              size_t count) {
+    if (!file_) {
+        nodes_.insert(nodes_.end(), digests, digests + count * hash_size_);
+        return;
+    }
+    file_->clear();
+    file_->seekp(static_cast<std::streamoff>(MMR_HEADER + position * hash_size_));
+    file_->write(reinterpret_cast<const char*>(digests),
+                 static_cast<std::streamsize>(count * hash_size_));
+    file_->flush();
+    if (!*file_) {
+        throw std::runtime_error("Could not write node file");
+    }
+}
@@ -0,0 +1,285 @@
+#include "skein3.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <string>
+
+// Outboard encoding: the tree_hash nodes of some content, stored apart from
+// it, so any range can be checked against the root with O(log n) digests
+
+namespace {
+    constexpr char OUTBOARD_MAGIC[8] = {'S', 'K', '3', 'O', 'U', 'T', 'B', 'D'};
+    constexpr uint64_t OUTBOARD_VERSION = Skein3::VerifiedReader::FORMAT_VERSION;
+    constexpr size_t OUTBOARD_FINGERPRINT = 32;
+    // Magic, version, four tree parameters, fingerprint and content size
+    constexpr size_t OUTBOARD_HEADER = 8 + 8 + 4 * 8 + OUTBOARD_FINGERPRINT + 8;
+    constexpr size_t NODE_TASK_BYTES = 64 * 1024;
+
+    void put_u64(uint8_t* out, uint64_t value) {
+        for (size_t i = 0; i < 8; ++i) {
+            out[i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+
+    // The header is not checksummed: a reader rebuilds it from its own
+    // config and trusted size and compares it byte for byte
+    void outboard_header(uint8_t* header, size_t hash_size, size_t leaf_size,
+                         size_t fan_out, size_t max_height,
+                         const uint64_t* fingerprint, uint64_t size) {
+        std::memcpy(header, OUTBOARD_MAGIC, sizeof(OUTBOARD_MAGIC));
+        put_u64(header + 8, OUTBOARD_VERSION);
+        put_u64(header + 16, hash_size);
+        put_u64(header + 24, leaf_size);
+        put_u64(header + 32, fan_out);
+        put_u64(header + 40, max_height);
+        std::memcpy(header + 48, fingerprint, OUTBOARD_FINGERPRINT);
+        put_u64(header + 48 + OUTBOARD_FINGERPRINT, size);
+    }
+}
+
+// VerifiedReader implementation
+
+std::vector<uint8_t> Skein3::VerifiedReader::write_outboard(ByteView data, std::ostream& out,
+                                                            const Config& config) {
+    if (data.size == 0) {
+        throw std::invalid_argument("Empty message");
+    }
+    TreeShape shape(config);
+    const size_t hash_size = shape.hash_size;
+    uint8_t header[OUTBOARD_HEADER];
+    outboard_header(header, hash_size, shape.leaf_size, shape.fan_out, shape.max_height,
+                    shape.chains[0].data(), data.size);
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    // Each level is hashed on the pool from the one below and written out.
+    // The root is not stored; readers get it from a trusted source.
+    std::vector<uint8_t> level;
+    std::vector<uint8_t> parents;
+    const uint8_t* nodes = data.data;
+    size_t bytes = data.size;
+    size_t piece = shape.leaf_size;
+    for (size_t height = 0;; ++height) {
+        const size_t count = (bytes + piece - 1) / piece;
+        const size_t per_task = std::max<size_t>(1, NODE_TASK_BYTES / piece);
+        shape.extend(height);
+        parents.resize(count * hash_size);
+        const uint64_t tag = TreeShape::tag(height);
+        ThreadPool::shared().parallel_for((count + per_task - 1) / per_task, [&](size_t t) {
+            const size_t first = t * per_task;
+            hash_pieces(shape.chains[height], nodes + first * piece,
+                        std::min(per_task * piece, bytes - first * piece), piece, hash_size,
+                        parents.data() + first * hash_size, &tag);
+        });
+        if (count == 1) {
+            break;
+        }
+        out.write(reinterpret_cast<const char*>(parents.data()),
+                  static_cast<std::streamsize>(parents.size()));
+        level.swap(parents);
+        nodes = level.data();
+        bytes = level.size();
+        piece = shape.group_size(height + 1, count) * hash_size;
+    }
+    out.flush();
+    if (!out) {
+        throw std::runtime_error("Could not write outboard");
+    }
+    return parents;
+}
+
+std::vector<uint8_t> Skein3::VerifiedReader::write_outboard(ByteView data,
+                                                            const std::string& filename,
+                                                            const Config& config) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file for writing");
+    }
+    return write_outboard(data, file, config);
+}
+
+Skein3::VerifiedReader::VerifiedReader(ByteView root, uint64_t size, std::istream& outboard,
+                                       const Config& config)
+    : shape_(config)
+    , size_(size)
+    , outboard_(outboard)
+    , root_(root.data, root.data + root.size)
+    , position_(0)
+    , failed_(false) {
+    if (root.size != shape_.hash_size) {
+        throw std::invalid_argument("Root size does not match the config");
+    }
+    if (size == 0) {
+        throw std::invalid_argument("Empty message");
+    }
+
+    uint8_t expected[OUTBOARD_HEADER];
+    outboard_header(expected, shape_.hash_size, shape_.leaf_size, shape_.fan_out,
+                    shape_.max_height, shape_.chains[0].data(), size);
+    uint8_t header[OUTBOARD_HEADER];
+    outboard_.clear();
+    outboard_.seekg(0);
+    outboard_.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (static_cast<size_t>(outboard_.gcount()) != sizeof(header) ||
+        std::memcmp(header, OUTBOARD_MAGIC, sizeof(OUTBOARD_MAGIC)) != 0) {
+        throw std::runtime_error("Not a Skein3 outboard");
+    }
+    if (std::memcmp(header, expected, sizeof(header)) != 0) {
+        throw std::runtime_error("Outboard was written for a different config or size");
+    }
+
+    // Node counts per height, as write_outboard reduces them
+    size_t count = static_cast<size_t>((size + shape_.leaf_size - 1) / shape_.leaf_size);
+    uint64_t offset = OUTBOARD_HEADER;
+    counts_.push_back(count);
+    offsets_.push_back(offset);
+    for (size_t height = 1; count > 1; ++height) {
+        offset += static_cast<uint64_t>(count) * shape_.hash_size;
+        const size_t group = shape_.group_size(height, count);
+        count = (count + group - 1) / group;
+        counts_.push_back(count);
+        offsets_.push_back(offset);
+    }
+    shape_.extend(counts_.size() - 1);
+    group_parent_.assign(counts_.size() - 1, SIZE_MAX);
+    groups_.resize(counts_.size() - 1);
+}
+
+std::pair<uint64_t, uint64_t> Skein3::VerifiedReader::leaf_range(uint64_t begin,
+                                                                 uint64_t end) const {
+    if (begin > end || end > size_) {
+        throw std::invalid_argument("Range is outside the content");
+    }
+    const uint64_t leaf = shape_.leaf_size;
+    return {begin / leaf * leaf, std::min(size_, (end + leaf - 1) / leaf * leaf)};
+}
+
+const uint8_t* Skein3::VerifiedReader::trusted_node(size_t height, size_t index) {
+    const size_t hash_size = shape_.hash_size;
+    if (height + 1 == counts_.size()) {
+        return root_.data();
+    }
+
+    const size_t group = shape_.group_size(height + 1, counts_[height]);
+    const size_t parent = index / group;
+    if (group_parent_[height] != parent) {
+        // The parent is verified first, so a bad group is never cached
+        const uint8_t* parent_digest = trusted_node(height + 1, parent);
+        if (parent_digest == nullptr) {
+            return nullptr;
+        }
+        const size_t nodes = std::min(group, counts_[height] - parent * group);
+        std::vector<uint8_t>& digests = groups_[height];
+        digests.resize(nodes * hash_size);
+        group_parent_[height] = SIZE_MAX;
+        outboard_.clear();
+        outboard_.seekg(static_cast<std::streamoff>(
+            offsets_[height] + static_cast<uint64_t>(parent) * group * hash_size));
+        outboard_.read(reinterpret_cast<char*>(digests.data()),
+                       static_cast<std::streamsize>(digests.size()));
+        if (static_cast<size_t>(outboard_.gcount()) != digests.size()) {
+            return nullptr;
+        }
+
+        uint8_t digest[Threefish3::BLOCK_SIZE];
+        tree_node(shape_.chains[height + 1], height + 1, ByteView(digests.data(), digests.size()),
+                  hash_size, digest);
+        if (std::memcmp(digest, parent_digest, hash_size) != 0) {
+            return nullptr;
+        }
+        group_parent_[height] = parent;
+    }
+    return groups_[height].data() + (index - parent * group) * hash_size;
+}
+
+bool Skein3::VerifiedReader::verify(uint64_t offset, ByteView data) {
+    const size_t leaf_size = shape_.leaf_size;
+    const size_t hash_size = shape_.hash_size;
+    if (offset > size_ || data.size > size_ - offset) {
+        throw std::invalid_argument("Range is outside the content");
+    }
+    const uint64_t end = offset + data.size;
+    if (offset % leaf_size != 0 || (end % leaf_size != 0 && end != size_)) {
+        throw std::invalid_argument("Range is not aligned to leaves");
+    }
+    if (data.size == 0) {
+        return true;
+    }
+
+    // Hash the leaves in parallel, then walk them against the trusted nodes
+    const size_t first = static_cast<size_t>(offset / leaf_size);
+    const size_t leaves = (data.size + leaf_size - 1) / leaf_size;
+    leaf_digests_.resize(leaves * hash_size);
+    const size_t leaves_per_task = std::max<size_t>(1, NODE_TASK_BYTES / leaf_size);
+    const uint64_t tag = TreeShape::tag(0);
+    ThreadPool::shared().parallel_for((leaves + leaves_per_task - 1) / leaves_per_task,
+                                      [&](size_t t) {
+        const size_t leaf = t * leaves_per_task;
+        const size_t bytes = std::min(leaves_per_task * leaf_size, data.size - leaf * leaf_size);
+        hash_pieces(shape_.chains[0], data.data + leaf * leaf_size, bytes,
+                    leaf_size, hash_size, leaf_digests_.data() + leaf * hash_size, &tag);
+    });
+
+    for (size_t i = 0; i < leaves; ++i) {
+        const uint8_t* expected = trusted_node(0, first + i);
+        if (expected == nullptr ||
+            std::memcmp(expected, leaf_digests_.data() + i * hash_size, hash_size) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Skein3::VerifiedReader::update(ByteView data) {
+    const size_t leaf_size = shape_.leaf_size;
+    if (failed_ || data.size > size_ - position_ - buffer_.size()) {
+        failed_ = true;
+        return false;
+    }
+
+    size_t used = 0;
+    if (!buffer_.empty()) {
+        used = std::min(leaf_size - buffer_.size(), data.size);
+        buffer_.insert(buffer_.end(), data.data, data.data + used);
+        if (buffer_.size() < leaf_size) {
+            return true;
+        }
+        if (!verify(position_, ByteView(buffer_.data(), buffer_.size()))) {
+            failed_ = true;
+            return false;
+        }
+        position_ += leaf_size;
+        buffer_.clear();
+    }
+
+    // Whole leaves are checked in place, only a partial one is copied
+    const size_t whole = (data.size - used) / leaf_size * leaf_size;
+    if (whole > 0) {
+        if (!verify(position_, ByteView(data.data + used, whole))) {
+            failed_ = true;
+            return false;
+        }
+        position_ += whole;
+        used += whole;
+    }
+    buffer_.assign(data.data + used, data.data + data.size);
+    return true;
+}
+
+bool Skein3::VerifiedReader::finish() {
+    if (failed_ || position_ + buffer_.size() != size_) {
+        return false;
+    }
+    if (!buffer_.empty()) {
+        if (!verify(position_, ByteView(buffer_.data(), buffer_.size()))) {
+            failed_ = true;
+            return false;
+        }
+        position_ = size_;
+        buffer_.clear();
+    }
+    return true;
+}
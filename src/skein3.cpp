@@ -1,12 +1,18 @@
 #include "skein3.h"
+#include <algorithm>
 #include <cstring>
 #include <thread>
 #include <future>
+#include <atomic>
+#include <chrono>
 #include <queue>
 #include <mutex>
+#include <new>
 #include <fstream>
 #include <iostream>
 #include "neural_adaptation.h"
+#include "thread_pool.h"
+#include "state_io.h"
 
 namespace {
     // Constants for domain separation
@@ -17,6 +23,57 @@ namespace {
     constexpr uint64_t DOMAIN_MAC = 43;      // MAC processing
     constexpr uint64_t DOMAIN_TREE = 64;     // Tree hashing
     
+    // Tree task sizing: bytes hashed per pool task, and parents per task
+    // when reducing the levels above the per-task subtrees
+    constexpr size_t TREE_MIN_TASK_BYTES = 64 * 1024;
+    constexpr size_t TREE_MAX_TASK_BYTES = 16 * 1024 * 1024;
+    constexpr size_t TREE_LEVEL_TASK_NODES = 256;
+
+    // Bytes of input per pool task in StreamingTreeHasher
+    constexpr size_t TREE_STREAM_RUN_BYTES = 1024 * 1024;
+
+    // Batch task sizing: a task ends after this many bytes or messages.
+    // Merkle levels are split into tasks of this many parents.
+    constexpr size_t BATCH_TASK_BYTES = 64 * 1024;
+    constexpr size_t BATCH_TASK_MESSAGES = 512;
+    constexpr size_t MERKLE_TASK_NODES = 512;
+
+    // Merkle levels start on a cache line, so no digest straddles two
+    constexpr size_t DIGEST_ALIGNMENT = 64;
+
+    struct AlignedDelete {
+        void operator()(uint8_t* data) const {
+            ::operator delete(data, std::align_val_t(DIGEST_ALIGNMENT));
+        }
+    };
+    using AlignedDigests = std::unique_ptr<uint8_t[], AlignedDelete>;
+
+    AlignedDigests allocate_digests(size_t size) {
+        return AlignedDigests(static_cast<uint8_t*>(
+            ::operator new(std::max<size_t>(size, 1), std::align_val_t(DIGEST_ALIGNMENT))));
+    }
+
+    // Consecutive messages cut into tasks by size; task t is messages
+    // [starts[t], starts[t + 1])
+    std::vector<size_t> batch_starts(const size_t* sizes, size_t count) {
+        std::vector<size_t> starts{0};
+        size_t bytes = 0;
+        for (size_t i = 0; i < count; ++i) {
+            bytes += sizes[i];
+            if (bytes >= BATCH_TASK_BYTES || i + 1 - starts.back() == BATCH_TASK_MESSAGES) {
+                starts.push_back(i + 1);
+                bytes = 0;
+            }
+        }
+        if (starts.back() != count) {
+            starts.push_back(count);
+        }
+        return starts;
+    }
+
+    // Bound messages end in a block holding the tag and the length; they
+    // are copied out and hashed this many at a time
+
     // Tweak flags for block processing
     constexpr uint64_t T1_FIRST = 1ULL << 62;  // First block flag
     constexpr uint64_t T1_FINAL = 1ULL << 63;  // Final block flag
@@ -56,23 +113,6 @@ namespace {
         {}
     };
     
-    // Block processing functions
-    void UBI(std::array<uint64_t, Threefish3::NUM_WORDS>& G,
-             const std::array<uint64_t, Threefish3::NUM_WORDS>& block,
-             const std::array<uint64_t, 3>& tweak,
-             Threefish3::SecurityMode sec_mode) {
-        // Create Threefish3 instance
-        Threefish3 cipher(G, tweak, sec_mode);
-        
-        // Encryption and XOR operations
-        std::array<uint64_t, Threefish3::NUM_WORDS> cipher_text;
-        cipher.encrypt(block, cipher_text);
-        
-        for (size_t i = 0; i < Threefish3::NUM_WORDS; ++i) {
-            G[i] = block[i] ^ cipher_text[i];
-        }
-    }
-
     // Neural network instance
     static NeuralHashAdapter::Network createDefaultNetwork() {
         return NeuralHashAdapter::Network({64, 128, 256, 128, 64});
@@ -96,29 +136,143 @@ namespace {
         0x5DB62599DF6CA7B0, 0xEABE394CA9D5C3F4,
         0x991112C71A75B523, 0xAE18A40B660FCC33
     };
+
+    // Konfigürasyon bloğunu hazırla
+    // Personalization fills the config block from first_word to the end
+    void put_person_string(std::array<uint64_t, Threefish3::NUM_WORDS>& cfg_block,
+                           const Skein3::Config& config,
+                           size_t first_word) {
+        if (config.personalization) {
+            size_t person_size = std::min(config.person_string.size(),
+                                        (Threefish3::NUM_WORDS - first_word) * sizeof(uint64_t));
+            std::memcpy(&cfg_block[first_word],
+                       config.person_string.data(),
+                       person_size);
+        }
+    }
+
+    std::array<uint64_t, Threefish3::NUM_WORDS> make_config_block(const Skein3::Config& config) {
+        std::array<uint64_t, Threefish3::NUM_WORDS> cfg_block = {};
+        cfg_block[0] = SCHEMA_VERSION;
+        cfg_block[1] = static_cast<uint64_t>(config.size);
+        cfg_block[2] = static_cast<uint64_t>(config.mode);
+        put_person_string(cfg_block, config, 3);
+        return cfg_block;
+    }
+
+    // Tree parametreleri, değerlerin alt sınırları uygulanmış haliyle
+    size_t tree_leaf_bytes(const Skein3::Config& config) {
+        return std::max(size_t(1024), config.tree_leaf_size);
+    }
+
+    size_t tree_children(const Skein3::Config& config) {
+        return std::max(size_t(2), config.tree_fan_out);
+    }
+
+    // Tree nodes carry the tree shape and their own height after the mode
+    // word, so a tree digest pins its layout, and leaves, internal nodes
+    // and plain hashes all start from different chaining values
+    std::array<uint64_t, Threefish3::NUM_WORDS> make_tree_config_block(
+        const Skein3::Config& config, size_t height) {
+        std::array<uint64_t, Threefish3::NUM_WORDS> cfg_block = {};
+        cfg_block[0] = SCHEMA_VERSION;
+        cfg_block[1] = static_cast<uint64_t>(config.size);
+        cfg_block[2] = static_cast<uint64_t>(Skein3::HashMode::TREE);
+        cfg_block[3] = tree_leaf_bytes(config);
+        cfg_block[4] = tree_children(config);
+        cfg_block[5] = config.tree_max_height;
+        cfg_block[6] = height;
+        put_person_string(cfg_block, config, 7);
+        return cfg_block;
+    }
+
+    // Post-config chaining values, most recently used first. The config
+    // block is the key: the IV depends on nothing else. Per thread, so the
+    // lookup needs no lock.
+    class IvCache {
+    public:
+        using Words = std::array<uint64_t, Threefish3::NUM_WORDS>;
+
+        bool lookup(const Words& cfg_block, Words& iv) {
+            for (size_t i = 0; i < used_; ++i) {
+                if (entries_[i].cfg_block == cfg_block) {
+                    std::rotate(entries_.begin(), entries_.begin() + i,
+                                entries_.begin() + i + 1);
+                    iv = entries_[0].iv;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void insert(const Words& cfg_block, const Words& iv) {
+            used_ = std::min(used_ + 1, CAPACITY);
+            std::rotate(entries_.begin(), entries_.begin() + used_ - 1,
+                        entries_.begin() + used_);
+            entries_[0] = {cfg_block, iv};
+        }
+
+    private:
+        static constexpr size_t CAPACITY = 8;
+        struct Entry {
+            Words cfg_block;
+            Words iv;
+        };
+        std::array<Entry, CAPACITY> entries_;
+        size_t used_ = 0;
+    };
+
+    thread_local IvCache iv_cache;
+
+    // MAC output transformation input
+    const std::array<uint64_t, Threefish3::NUM_WORDS> ZERO_BLOCK = {};
+
+    // Zeroing through volatile so the compiler cannot drop it as a dead store
+    void secure_zero(void* data, size_t size) {
+        volatile uint8_t* bytes = static_cast<volatile uint8_t*>(data);
+        while (size--) {
+            *bytes++ = 0;
+        }
+    }
+
+    // Messages of at most one block: no block context, no key schedule,
+    // nothing on the heap. An empty message has no blocks, so its digest
+    // is the IV itself.
+    inline void hash_single_block(const std::array<uint64_t, Threefish3::NUM_WORDS>& iv,
+                                  Skein3::ByteView message,
+                                  uint8_t* digest,
+                                  size_t hash_size) {
+        if (message.size == 0) {
+            std::memcpy(digest, iv.data(), hash_size);
+            return;
+        }
+
+        const uint8_t* input = message.data;
+        std::array<uint64_t, Threefish3::NUM_WORDS> padded;
+        if (message.size < Threefish3::BLOCK_SIZE) {
+            padded.fill(0);
+            std::memcpy(padded.data(), message.data, message.size);
+            input = reinterpret_cast<const uint8_t*>(padded.data());
+        }
+
+        std::array<uint64_t, Threefish3::NUM_WORDS> chain;
+        Threefish3::ubi_block(iv, input, chain);
+        std::memcpy(digest, chain.data(), hash_size);
+    }
 }
 
 // Static member functions of Skein3 class
 void Skein3::process_config_block(std::array<uint64_t, Threefish3::NUM_WORDS>& state,
                                 const Config& config) {
+    process_config_block(state, make_config_block(config));
+}
+
+void Skein3::process_config_block(std::array<uint64_t, Threefish3::NUM_WORDS>& state,
+                                const std::array<uint64_t, Threefish3::NUM_WORDS>& cfg_block) {
     BlockContext ctx;
     ctx.domain = DOMAIN_CFG;
     ctx.state = state;
     
-    // Prepare configuration block
-    std::array<uint64_t, Threefish3::NUM_WORDS> cfg_block = {};
-    cfg_block[0] = SCHEMA_VERSION;
-    cfg_block[1] = static_cast<uint64_t>(config.size);
-    cfg_block[2] = static_cast<uint64_t>(config.mode);
-    
-    if (config.personalization) {
-        size_t person_size = std::min(config.person_string.size(), 
-                                    (Threefish3::NUM_WORDS - 3) * sizeof(uint64_t));
-        std::memcpy(&cfg_block[3], 
-                   config.person_string.data(), 
-                   person_size);
-    }
-    
     // Process configuration block
     ctx.is_final = true;
     process_block(ctx, 
@@ -129,11 +283,41 @@ void Skein3::process_config_block(std::array<uint64_t, Threefish3::NUM_WORDS>& s
     state = ctx.state;
 }
 
-// Main hash function implementation
-std::vector<uint8_t> Skein3::hash(
-    const std::vector<uint8_t>& message,
-    const Config& config
-) {
+Threefish3::SecurityMode Skein3::security_mode(const Config& config) {
+    switch (config.size) {
+        case HashSize::HASH_1024:
+            return Threefish3::SecurityMode::QUANTUM;
+        case HashSize::HASH_512:
+            return Threefish3::SecurityMode::ENHANCED;
+        default:
+            return Threefish3::SecurityMode::STANDARD;
+    }
+}
+
+std::array<uint64_t, Threefish3::NUM_WORDS> Skein3::initial_chain(const Config& config) {
+    return initial_chain(make_config_block(config));
+}
+
+std::array<uint64_t, Threefish3::NUM_WORDS> Skein3::tree_chain(const Config& config,
+                                                               size_t height) {
+    return initial_chain(make_tree_config_block(config, height));
+}
+
+std::array<uint64_t, Threefish3::NUM_WORDS> Skein3::initial_chain(
+    const std::array<uint64_t, Threefish3::NUM_WORDS>& cfg_block) {
+    std::array<uint64_t, Threefish3::NUM_WORDS> state;
+    if (iv_cache.lookup(cfg_block, state)) {
+        return state;
+    }
+
+    // Initial state'i sabit IV'den kopyala ve konfigürasyon bloğunu işle
+    state = INITIAL_STATE;
+    process_config_block(state, cfg_block);
+    iv_cache.insert(cfg_block, state);
+    return state;
+}
+
+void Skein3::check_hash_config(const Config& config) {
     // License kontrolü ekleyelim
     if (config.size == HashSize::HASH_1024) {
         if (!LicenseManager::getInstance().isCommercialUse()) {
@@ -145,37 +329,59 @@ std::vector<uint8_t> Skein3::hash(
     if (config.mode == HashMode::TREE && config.tree_fan_out == 0) {
         throw std::invalid_argument("Tree fan-out cannot be zero");
     }
+    if (config.mode == HashMode::TREE && config.tree_max_height == 0) {
+        throw std::invalid_argument("Tree max height cannot be zero");
+    }
+}
 
-    // Hash boyutunu ayarla
-    size_t hash_size = static_cast<size_t>(config.size) / 8;
-    std::vector<uint8_t> result(hash_size);
+// Main hash function implementation
+std::vector<uint8_t> Skein3::hash(
+    const std::vector<uint8_t>& message,
+    const Config& config
+) {
+    return hash(ByteView(message), config);
+}
 
-    // Güvenlik modunu belirle
-    Threefish3::SecurityMode sec_mode;
-    switch (config.size) {
-        case HashSize::HASH_1024:
-            sec_mode = Threefish3::SecurityMode::QUANTUM;
-            break;
-        case HashSize::HASH_512:
-            sec_mode = Threefish3::SecurityMode::ENHANCED;
-            break;
-        default:
-            sec_mode = Threefish3::SecurityMode::STANDARD;
+std::vector<uint8_t> Skein3::hash(const uint8_t* data, size_t size, const Config& config) {
+    return hash(ByteView(data, size), config);
+}
+
+std::vector<uint8_t> Skein3::hash(ByteView message, const Config& config) {
+    std::vector<uint8_t> result(digest_size(config));
+    hash(message, result.data(), config);
+    return result;
+}
+
+void Skein3::check_digest_size(const Config& config, size_t bits) {
+    if (static_cast<size_t>(config.size) != bits) {
+        throw std::invalid_argument("Digest size does not match config.size");
     }
+}
 
-    // Initial state'i sabit IV'den kopyala
-    std::array<uint64_t, Threefish3::NUM_WORDS> state = INITIAL_STATE;
+void Skein3::hash(ByteView message, uint8_t* digest, const Config& config) {
+    check_hash_config(config);
+    hash_message(initial_chain(config), security_mode(config), message, digest,
+                 digest_size(config));
+}
 
-    // Konfigürasyon bloğunu işle
-    process_config_block(state, config);
+void Skein3::hash_message(const std::array<uint64_t, Threefish3::NUM_WORDS>& iv,
+                          Threefish3::SecurityMode sec_mode,
+                          ByteView message,
+                          uint8_t* digest,
+                          size_t hash_size) {
+    // Kısa mesajlar (trafiğin çoğu) tek UBI çağrısıyla biter
+    if (message.size <= Threefish3::BLOCK_SIZE) {
+        hash_single_block(iv, message, digest, hash_size);
+        return;
+    }
 
     // Mesaj bloklarını işle
     BlockContext ctx;
-    ctx.state = state;
+    ctx.state = iv;
     ctx.is_first = true;
     
     const size_t block_size = Threefish3::BLOCK_SIZE;
-    size_t remaining = message.size();
+    size_t remaining = message.size;
     size_t offset = 0;
     
     while (remaining > 0) {
@@ -186,7 +392,7 @@ std::vector<uint8_t> Skein3::hash(
         }
         
         process_block(ctx, 
-                     message.data() + offset, 
+                     message.data + offset, 
                      current_size,
                      sec_mode);
         
@@ -195,117 +401,300 @@ std::vector<uint8_t> Skein3::hash(
         remaining -= current_size;
     }
 
-    // Son state'i result vektörüne kopyala
-    std::memcpy(result.data(), ctx.state.data(), hash_size);
-    
+    // Son state'i çıktı tamponuna kopyala
+    std::memcpy(digest, ctx.state.data(), hash_size);
+}
+
+// Hasher implementation
+Skein3::Hasher::Hasher(const Config& config)
+    : sec_mode_(security_mode(config))
+    , hash_size_(Skein3::digest_size(config)) {
+    check_hash_config(config);
+    iv_ = initial_chain(config);
+}
+
+std::vector<uint8_t> Skein3::Hasher::hash(ByteView message) const {
+    std::vector<uint8_t> result(hash_size_);
+    hash(message, result.data());
     return result;
 }
 
+void Skein3::Hasher::hash(ByteView message, uint8_t* digest) const {
+    hash_message(iv_, sec_mode_, message, digest, hash_size_);
+}
+
+// Midstate checkpoints of the streaming hashers
+namespace {
+    constexpr char CHECKPOINT_MAGIC[8] = {'S', 'K', '3', 'M', 'I', 'D', 'S', 'T'};
+    constexpr uint64_t CHECKPOINT_VERSION = 3;
+    constexpr uint64_t CHECKPOINT_PLAIN = 0;
+    constexpr uint64_t CHECKPOINT_TREE = 1;
+    constexpr size_t CHECKPOINT_FINGERPRINT = 32;
+
+    void write_checkpoint_header(StateWriter& writer, uint64_t kind, size_t hash_size,
+                                 const void* fingerprint) {
+        writer.bytes(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        writer.u64(CHECKPOINT_VERSION);
+        writer.u64(kind);
+        writer.u64(hash_size);
+        writer.bytes(fingerprint, CHECKPOINT_FINGERPRINT);
+    }
+
+    void read_checkpoint_header(StateReader& reader, uint64_t kind, size_t hash_size,
+                                const void* fingerprint) {
+        char magic[sizeof(CHECKPOINT_MAGIC)];
+        reader.bytes(magic, sizeof(magic));
+        if (std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0) {
+            throw std::runtime_error("Not a Skein3 checkpoint");
+        }
+        if (reader.u64() != CHECKPOINT_VERSION) {
+            throw std::runtime_error("Unsupported checkpoint version");
+        }
+        if (reader.u64() != kind) {
+            throw std::runtime_error("Checkpoint belongs to a different kind of hasher");
+        }
+        bool same_config = reader.u64() == hash_size;
+        uint8_t stored[CHECKPOINT_FINGERPRINT];
+        reader.bytes(stored, sizeof(stored));
+        if (!same_config || std::memcmp(stored, fingerprint, sizeof(stored)) != 0) {
+            throw std::runtime_error("Checkpoint was saved with a different config");
+        }
+    }
+}
+
 // StreamingHasher implementation
 Skein3::StreamingHasher::StreamingHasher(const Config& config)
     : config_(config)
+    , sec_mode_(security_mode(config))
+    , buffered_(0)
     , total_bytes_(0) {
-    state_.fill(0);
-    process_config_block(state_, config);
+    check_hash_config(config);
+    iv_ = initial_chain(config);
+    reset();
+}
+
+void Skein3::StreamingHasher::reset() {
+    ctx_ = BlockContext();
+    ctx_.state = iv_;
+    buffered_ = 0;
+    total_bytes_ = 0;
+}
+
+void Skein3::StreamingHasher::compress(const uint8_t* block) {
+    process_block(ctx_, block, Threefish3::BLOCK_SIZE, sec_mode_);
+    ctx_.is_first = false;
 }
 
 void Skein3::StreamingHasher::update(const std::vector<uint8_t>& data) {
-    // Implement update logic
-    buffer_.insert(buffer_.end(), data.begin(), data.end());
-    total_bytes_ += data.size();
+    update(ByteView(data));
 }
 
-std::vector<uint8_t> Skein3::StreamingHasher::finalize() {
-    // Implement finalization logic
-    size_t hash_size = static_cast<size_t>(config_.size) / 8;
-    std::vector<uint8_t> result(hash_size, 0);
+void Skein3::StreamingHasher::update(const uint8_t* data, size_t size) {
+    update(ByteView(data, size));
+}
+
+void Skein3::StreamingHasher::update(ByteView data) {
+    const size_t block_size = Threefish3::BLOCK_SIZE;
+    const uint8_t* input = data.data;
+    size_t remaining = data.size;
+    total_bytes_ += remaining;
+
+    while (remaining > 0) {
+        // More input arrived, so the held-back block is not the last one
+        if (buffered_ == block_size) {
+            compress(buffer_.data());
+            buffered_ = 0;
+        }
+
+        // Whole blocks are compressed in place, except the newest one
+        if (buffered_ == 0) {
+            while (remaining > block_size) {
+                compress(input);
+                input += block_size;
+                remaining -= block_size;
+            }
+        }
 
-    // Placeholder logic
-    if (!buffer_.empty()) {
-        result[0] = buffer_[0];
+        size_t take = std::min(block_size - buffered_, remaining);
+        std::memcpy(buffer_.data() + buffered_, input, take);
+        buffered_ += take;
+        input += take;
+        remaining -= take;
     }
+}
 
+std::vector<uint8_t> Skein3::StreamingHasher::finalize() {
+    std::vector<uint8_t> result(digest_size(config_));
+    finalize(result.data());
     return result;
 }
 
+void Skein3::StreamingHasher::finalize(uint8_t* digest) {
+    // An empty message has no blocks; its digest is the IV
+    if (buffered_ > 0) {
+        ctx_.is_final = true;
+        process_block(ctx_, buffer_.data(), buffered_, sec_mode_);
+    }
+    std::memcpy(digest, ctx_.state.data(), digest_size(config_));
+    reset();
+}
+
+void Skein3::StreamingHasher::save(std::ostream& out) const {
+    StateWriter writer(out, "checkpoint");
+    write_checkpoint_header(writer, CHECKPOINT_PLAIN, digest_size(config_), iv_.data());
+    writer.u64(total_bytes_);
+    writer.u64(ctx_.bytes_processed);
+    for (uint64_t word : ctx_.state) {
+        writer.u64(word);
+    }
+    writer.bytes(buffer_.data(), buffered_);
+    writer.finish();
+}
+
+void Skein3::StreamingHasher::save(const std::string& filename) const {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file for writing");
+    }
+    save(file);
+}
+
+Skein3::StreamingHasher Skein3::StreamingHasher::load(std::istream& in, const Config& config) {
+    StreamingHasher hasher(config);
+    StateReader reader(in, "checkpoint");
+    read_checkpoint_header(reader, CHECKPOINT_PLAIN, digest_size(config), hasher.iv_.data());
+
+    // Whole blocks are compressed and the tail, at most one block, is held
+    // back; it is only empty before the first byte
+    const uint64_t total = reader.u64();
+    const uint64_t compressed = reader.u64();
+    if (compressed > total || compressed % Threefish3::BLOCK_SIZE != 0 ||
+        total - compressed > Threefish3::BLOCK_SIZE || (total > 0 && total == compressed)) {
+        throw std::runtime_error("Inconsistent checkpoint");
+    }
+    for (auto& word : hasher.ctx_.state) {
+        word = reader.u64();
+    }
+    hasher.buffered_ = static_cast<size_t>(total - compressed);
+    reader.bytes(hasher.buffer_.data(), hasher.buffered_);
+    reader.finish();
+
+    hasher.ctx_.bytes_processed = compressed;
+    hasher.ctx_.is_first = compressed == 0;
+    hasher.total_bytes_ = total;
+    return hasher;
+}
+
+Skein3::StreamingHasher Skein3::StreamingHasher::load(const std::string& filename,
+                                                      const Config& config) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file for reading");
+    }
+    return load(file, config);
+}
+
 // MAC function implementation
 std::vector<uint8_t> Skein3::mac(const std::vector<uint8_t>& message,
                                 const std::vector<uint8_t>& key,
                                 const Config& config) {
-    // Determine security mode
-    Threefish3::SecurityMode sec_mode;
-    switch (config.size) {
-        case HashSize::HASH_1024:
-            sec_mode = Threefish3::SecurityMode::QUANTUM;
-            break;
-        case HashSize::HASH_512:
-            sec_mode = Threefish3::SecurityMode::ENHANCED;
-            break;
-        default:
-            sec_mode = Threefish3::SecurityMode::STANDARD;
-    }
+    return mac(ByteView(message), ByteView(key), config);
+}
+
+std::vector<uint8_t> Skein3::mac(ByteView message, ByteView key, const Config& config) {
+    std::vector<uint8_t> result(digest_size(config));
+    mac(message, key, result.data(), config);
+    return result;
+}
+
+void Skein3::mac(ByteView message, ByteView key, uint8_t* digest, const Config& config) {
+    MacContext(key, config).mac(message, digest);
+}
 
+// MacContext implementation
+Skein3::MacContext::MacContext(ByteView key, const Config& config)
+    : sec_mode_(security_mode(config))
+    , hash_size_(Skein3::digest_size(config))
+    , secure_wipe_(config.secure_memory_wipe) {
     // Initialize state
-    std::array<uint64_t, Threefish3::NUM_WORDS> state;
-    state.fill(0);
-    
+    key_chain_.fill(0);
+
     // Process configuration block
-    process_config_block(state, config);
-    
-    // Process key block
+    process_config_block(key_chain_, config);
+
+    // Process key block; a key longer than one block is absorbed block by
+    // block instead of overrunning the padding buffer
     BlockContext key_ctx;
-    key_ctx.state = state;
+    key_ctx.state = key_chain_;
     key_ctx.domain = DOMAIN_MAC;
-    
-    process_block(key_ctx,
-                 key.data(),
-                 key.size(),
-                 sec_mode);
-    
-    // Process message blocks
-    BlockContext msg_ctx;
-    msg_ctx.state = key_ctx.state;
-    msg_ctx.domain = DOMAIN_MSG;
-    
+
     const size_t block_size = Threefish3::BLOCK_SIZE;
-    size_t remaining = message.size();
     size_t offset = 0;
-    
-    while (remaining > 0) {
-        size_t current_size = std::min(remaining, block_size);
-        bool is_last = (remaining <= block_size);
-        
-        if (is_last) {
-            msg_ctx.is_final = true;
-        }
-        
-        process_block(msg_ctx,
-                     message.data() + offset,
-                     current_size,
-                     sec_mode);
-        
+    do {
+        size_t current_size = std::min(key.size - offset, block_size);
+        process_block(key_ctx, key.data + offset, current_size, sec_mode_);
+        key_ctx.is_first = false;
         offset += current_size;
-        remaining -= current_size;
+    } while (offset < key.size);
+
+    key_chain_ = key_ctx.state;
+    if (secure_wipe_) {
+        secure_zero(key_ctx.state.data(), sizeof(key_ctx.state));
     }
-    
+}
+
+Skein3::MacContext::~MacContext() {
+    if (secure_wipe_) {
+        secure_zero(key_chain_.data(), sizeof(key_chain_));
+    }
+}
+
+std::vector<uint8_t> Skein3::MacContext::mac(ByteView message) const {
+    std::vector<uint8_t> result(hash_size_);
+    mac(message, result.data());
+    return result;
+}
+
+void Skein3::MacContext::mac(ByteView message, uint8_t* digest) const {
+    // Process message blocks from the keyed state, keeping the whole chain
+    std::array<uint64_t, Threefish3::NUM_WORDS> chain;
+    hash_message(key_chain_, sec_mode_, message,
+                 reinterpret_cast<uint8_t*>(chain.data()), sizeof(chain));
+
     // Output transformation
-    BlockContext out_ctx;
-    out_ctx.state = msg_ctx.state;
-    out_ctx.domain = DOMAIN_OUT;
-    out_ctx.is_final = true;
-    
-    std::array<uint64_t, Threefish3::NUM_WORDS> output_block = {};
-    process_block(out_ctx,
-                 reinterpret_cast<const uint8_t*>(output_block.data()),
-                 block_size,
-                 sec_mode);
-    
+    Threefish3::ubi_block(chain, reinterpret_cast<const uint8_t*>(ZERO_BLOCK.data()), chain);
+
     // Generate final MAC
-    size_t mac_size = static_cast<size_t>(config.size) / 8;
-    std::vector<uint8_t> result(mac_size);
-    std::memcpy(result.data(), out_ctx.state.data(), mac_size);
-    
-    return result;
+    std::memcpy(digest, chain.data(), hash_size_);
+}
+
+void Skein3::MacContext::batch_mac(const std::vector<ByteView>& messages,
+                                   uint8_t* digests) const {
+    std::vector<const uint8_t*> data;
+    std::vector<size_t> sizes;
+    data.reserve(messages.size());
+    sizes.reserve(messages.size());
+    for (const auto& message : messages) {
+        data.push_back(message.data);
+        sizes.push_back(message.size);
+    }
+
+    ubi_many(key_chain_, data.data(), sizes.data(), messages.size(), true,
+             hash_size_, digests);
+}
+
+std::vector<std::vector<uint8_t>> Skein3::MacContext::batch_mac(
+    const std::vector<ByteView>& messages) const {
+    std::vector<uint8_t> digests(messages.size() * hash_size_);
+    batch_mac(messages, digests.data());
+
+    std::vector<std::vector<uint8_t>> results;
+    results.reserve(messages.size());
+    for (size_t i = 0; i < messages.size(); ++i) {
+        results.emplace_back(digests.begin() + i * hash_size_,
+                             digests.begin() + (i + 1) * hash_size_);
+    }
+    return results;
 }
 
 // Tree hash implementation
@@ -313,82 +702,654 @@ std::vector<uint8_t> Skein3::tree_hash(
     const std::vector<uint8_t>& message,
     const Config& config
 ) {
-    // Güvenlik kontrolü
-    if (message.empty()) {
-        throw std::invalid_argument("Empty message");
-    }
+    return tree_hash(ByteView(message), config);
+}
 
-    // Leaf boyutu kontrolü
-    const size_t leaf_size = std::max(size_t(1024), config.tree_leaf_size);
-    
-    // Thread sayısı kontrolü
-    const size_t num_threads = std::min(
-        config.tree_fan_out,
-        (message.size() + leaf_size - 1) / leaf_size
-    );
+std::vector<uint8_t> Skein3::tree_hash(ByteView message, const Config& config) {
+    std::vector<uint8_t> result(digest_size(config));
+    tree_hash(message, result.data(), config);
+    return result;
+}
+
+void Skein3::tree_hash(ByteView message, uint8_t* digest, const Config& config) {
+    // Ağacın şekli yalnızca leaf boyutuna, fan-out'a ve en büyük yüksekliğe
+    // bağlı, thread sayısına değil
+    TreeShape shape(config);
+    const size_t hash_size = shape.hash_size;
 
-    // Leaf hash'lerini hesapla
-    std::vector<std::vector<uint8_t>> leaf_hashes(num_threads);
-    std::vector<std::thread> threads;
-
-    const size_t chunk_size = (message.size() + num_threads - 1) / num_threads;
-
-    for (size_t i = 0; i < num_threads; ++i) {
-        threads.emplace_back([&, i]() {
-            size_t start = i * chunk_size;
-            size_t end = std::min(start + chunk_size, message.size());
-            
-            if (start >= message.size()) return;
-
-            // Her leaf için normal hash hesapla
-            std::vector<uint8_t> chunk(
-                message.begin() + start,
-                message.begin() + end
-            );
-
-            Config leaf_config = config;
-            leaf_config.mode = HashMode::STANDARD;  // Leaf'ler için standard mod
-            
-            leaf_hashes[i] = hash(chunk, leaf_config);
+    // Boş mesaj tek, boş bir leaf'tir; kök o leaf'in digest'i
+    if (message.size == 0) {
+        tree_node(shape.chains[0], 0, message, hash_size, digest);
+        return;
+    }
+    const size_t num_leaves = (message.size + shape.leaf_size - 1) / shape.leaf_size;
+
+    // Her yükseklik için zincir değeri, görevler başlamadan bir kez
+    shape.extend(shape.root_height(num_leaves));
+
+    ThreadPool& pool = ThreadPool::shared();
+
+    // Her görev fan_out^height leaf'lik bir alt ağacı köküne kadar kendi
+    // başına indirger; görevler iş parçacığı başına birkaç tane olacak
+    // kadar küçük, görev yükünü önemsiz kılacak kadar büyük seçilir
+    const size_t target = std::min(TREE_MAX_TASK_BYTES,
+        std::max(TREE_MIN_TASK_BYTES, message.size / (4 * (pool.size() + 1))));
+    const size_t max_subtree_height = shape.subtree_height(target);
+    size_t subtree_height = 0;
+    size_t subtree_leaves = 1;
+    while (subtree_height < max_subtree_height && subtree_leaves < num_leaves) {
+        subtree_leaves *= shape.fan_out;
+        ++subtree_height;
+    }
+    const size_t subtree_bytes = subtree_leaves * shape.leaf_size;
+    const size_t num_subtrees = (num_leaves + subtree_leaves - 1) / subtree_leaves;
+
+    // Eksik son alt ağaç da diğerleriyle aynı yüksekliğe kadar indirgenir,
+    // böylece tek kalan düğümler her seviyede yeniden hash'lenir
+    std::vector<uint8_t> level(num_subtrees * hash_size);
+    pool.parallel_for(num_subtrees, [&](size_t s) {
+        const size_t offset = s * subtree_bytes;
+        tree_reduce(shape, message.data + offset,
+                    std::min(subtree_bytes, message.size - offset),
+                    num_subtrees == 1 ? SIZE_MAX : subtree_height,
+                    level.data() + s * hash_size);
+    });
+
+    // Alt ağaç köklerinin üzerindeki seviyeler, büyükse parçalar halinde paralel
+    size_t count = num_subtrees;
+    size_t height = subtree_height;
+    std::vector<uint8_t> parents((count + shape.fan_out - 1) / shape.fan_out * hash_size);
+    while (count > 1) {
+        ++height;
+        const size_t group = shape.group_size(height, count);
+        const size_t num_parents = (count + group - 1) / group;
+        const size_t tasks = (num_parents + TREE_LEVEL_TASK_NODES - 1) / TREE_LEVEL_TASK_NODES;
+        pool.parallel_for(tasks, [&](size_t t) {
+            const size_t first = t * TREE_LEVEL_TASK_NODES;
+            const size_t nodes = std::min(TREE_LEVEL_TASK_NODES * group, count - first * group);
+            tree_level(shape, height, level.data() + first * group * hash_size,
+                       nodes, parents.data() + first * hash_size);
         });
+        level.swap(parents);
+        count = num_parents;
     }
 
-    // Thread'lerin tamamlanmasını bekle
-    for (auto& thread : threads) {
-        thread.join();
+    std::memcpy(digest, level.data(), hash_size);
+}
+
+Skein3::TreeShape::TreeShape(const Config& tree_config)
+    : config(tree_config)
+    , leaf_size(tree_leaf_bytes(tree_config))
+    , fan_out(tree_children(tree_config))
+    , max_height(tree_config.tree_max_height)
+    , hash_size(digest_size(tree_config)) {
+    config.mode = HashMode::TREE;
+    check_hash_config(config);
+    chains.push_back(tree_chain(config, 0));
+}
+
+void Skein3::TreeShape::extend(size_t height) {
+    while (chains.size() <= height) {
+        chains.push_back(tree_chain(config, chains.size()));
     }
+}
+
+size_t Skein3::TreeShape::root_height(size_t num_leaves) const {
+    size_t height = 0;
+    for (size_t count = num_leaves; count > 1; ) {
+        ++height;
+        const size_t group = group_size(height, count);
+        count = (count + group - 1) / group;
+    }
+    return height;
+}
+
+size_t Skein3::TreeShape::subtree_height(size_t max_bytes) const {
+    size_t height = 0;
+    size_t leaves = 1;
+    while (height + 1 < max_height && fan_out <= max_bytes / (leaves * leaf_size)) {
+        leaves *= fan_out;
+        ++height;
+    }
+    return height;
+}
+
+void Skein3::tree_node(const std::array<uint64_t, Threefish3::NUM_WORDS>& chain,
+                       size_t height, ByteView data, size_t hash_size, uint8_t* digest) {
+    const uint64_t tag = TreeShape::tag(height);
+    ubi_many(chain, &data.data, &data.size, 1, false, hash_size, digest, &tag);
+}
+
+void Skein3::tree_level(const TreeShape& shape, size_t height,
+                        const uint8_t* nodes, size_t count, uint8_t* parents) {
+    // Kardeş digest'ler tamponda zaten yan yana, bu yüzden her ebeveyn
+    // kopyasız olarak yerinden hash'lenir
+    const uint64_t tag = TreeShape::tag(height);
+    hash_pieces(shape.chains[height], nodes, count * shape.hash_size,
+                shape.group_size(height, count) * shape.hash_size, shape.hash_size, parents,
+                &tag);
+}
+
+void Skein3::tree_reduce(const TreeShape& shape, const uint8_t* data, size_t size,
+                         size_t levels, uint8_t* root) {
+    const size_t hash_size = shape.hash_size;
+
+    // Leaf'ler doğrudan verinin içinden hash'lenir
+    size_t count = (size + shape.leaf_size - 1) / shape.leaf_size;
+    std::vector<uint8_t> nodes(count * hash_size);
+    std::vector<uint8_t> parents((count + shape.fan_out - 1) / shape.fan_out * hash_size);
+    const uint64_t tag = TreeShape::tag(0);
+    hash_pieces(shape.chains[0], data, size, shape.leaf_size, hash_size, nodes.data(), &tag);
+
+    for (size_t height = 1; levels == SIZE_MAX ? count > 1 : height <= levels; ++height) {
+        const size_t group = shape.group_size(height, count);
+        tree_level(shape, height, nodes.data(), count, parents.data());
+        nodes.swap(parents);
+        count = (count + group - 1) / group;
+    }
+    std::memcpy(root, nodes.data(), hash_size);
+}
 
-    // Tek leaf varsa direkt döndür
-    if (leaf_hashes.size() == 1) {
-        return leaf_hashes[0];
+void Skein3::tree_node_hash(ByteView data, size_t height, uint8_t* digest,
+                            const Config& config) {
+    Config tree_config = config;
+    tree_config.mode = HashMode::TREE;
+    check_hash_config(tree_config);
+    tree_node(tree_chain(config, height), height, data, digest_size(config), digest);
+}
+
+// StreamingTreeHasher implementation
+
+// A full run of leaves, reduced to its subtree root on the pool. Whoever
+// claims it first runs it: a pool worker, or the owner once it needs the
+// root and no worker has started, so waiting never depends on a free worker.
+struct Skein3::StreamingTreeHasher::Job {
+    std::shared_ptr<const TreeShape> shape;
+    size_t height;
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> root;
+    std::atomic<bool> claimed{false};
+    std::future<void> done;
+
+    void run() {
+        tree_reduce(*shape, data.data(), data.size(), height, root.data());
+    }
+};
+
+Skein3::StreamingTreeHasher::StreamingTreeHasher(const Config& config)
+    : max_jobs_(2 * (ThreadPool::shared().size() + 1))
+    , run_offset_(0)
+    , total_bytes_(0) {
+    auto shape = std::make_shared<TreeShape>(config);
+    run_height_ = shape->subtree_height(TREE_STREAM_RUN_BYTES);
+    shape->extend(run_height_);
+    run_bytes_ = shape->leaf_size;
+    for (size_t h = 0; h < run_height_; ++h) {
+        run_bytes_ *= shape->fan_out;
+    }
+    shape_ = std::move(shape);
+    run_.reserve(run_bytes_);
+}
+
+Skein3::StreamingTreeHasher::~StreamingTreeHasher() {
+    reset();
+}
+
+void Skein3::StreamingTreeHasher::reset() {
+    // Runs no worker has started are skipped; running ones own their data
+    for (auto& job : jobs_) {
+        job->claimed.exchange(true);
     }
+    jobs_.clear();
+    run_.clear();
+    run_offset_ = 0;
+    pending_.clear();
+    total_bytes_ = 0;
+}
 
-    // Merkle ağacını oluştur
-    while (leaf_hashes.size() > 1) {
-        size_t num_parents = (leaf_hashes.size() + 1) / 2;
-        std::vector<std::vector<uint8_t>> parent_hashes(num_parents);
+void Skein3::StreamingTreeHasher::update(const std::vector<uint8_t>& data) {
+    update(ByteView(data));
+}
+
+void Skein3::StreamingTreeHasher::update(const uint8_t* data, size_t size) {
+    update(ByteView(data, size));
+}
 
-        for (size_t i = 0; i < num_parents; ++i) {
-            std::vector<uint8_t> combined;
-            combined.insert(combined.end(), 
-                          leaf_hashes[i * 2].begin(), 
-                          leaf_hashes[i * 2].end());
+void Skein3::StreamingTreeHasher::update(ByteView data) {
+    const uint8_t* input = data.data;
+    size_t remaining = data.size;
+    total_bytes_ += remaining;
 
-            if (i * 2 + 1 < leaf_hashes.size()) {
-                combined.insert(combined.end(),
-                              leaf_hashes[i * 2 + 1].begin(),
-                              leaf_hashes[i * 2 + 1].end());
+    while (remaining > 0) {
+        size_t take = std::min(run_bytes_ - run_offset_ - run_.size(), remaining);
+        run_.insert(run_.end(), input, input + take);
+        input += take;
+        remaining -= take;
+
+        if (run_offset_ + run_.size() == run_bytes_) {
+            if (run_offset_ == 0) {
+                submit_run();
+            } else {
+                // Finish a run that a checkpoint split into leaves
+                hash_leaves(run_.size());
+                run_offset_ = 0;
             }
+        }
+    }
+}
+
+void Skein3::StreamingTreeHasher::submit_run() {
+    // Roots enter the tree in order, so finished runs leave from the front
+    while (!jobs_.empty() &&
+           (jobs_.size() >= max_jobs_ ||
+            jobs_.front()->done.wait_for(std::chrono::seconds(0)) == std::future_status::ready)) {
+        retire_oldest();
+    }
+
+    auto job = std::make_shared<Job>();
+    job->shape = shape_;
+    job->height = run_height_;
+    job->data.swap(run_);
+    job->root.resize(shape_->hash_size);
+
+    if (!spare_runs_.empty()) {
+        run_.swap(spare_runs_.back());
+        spare_runs_.pop_back();
+    }
+    run_.clear();
+    run_.reserve(run_bytes_);
+
+    job->done = ThreadPool::shared().enqueue([job]() {
+        if (!job->claimed.exchange(true)) {
+            job->run();
+        }
+    });
+    jobs_.push_back(std::move(job));
+}
+
+void Skein3::StreamingTreeHasher::retire_oldest() {
+    std::shared_ptr<Job> job = std::move(jobs_.front());
+    jobs_.pop_front();
+
+    if (!job->claimed.exchange(true)) {
+        job->run();
+    } else {
+        job->done.get();
+    }
+    push_node(job->height, job->root.data());
+    spare_runs_.push_back(std::move(job->data));
+}
+
+void Skein3::StreamingTreeHasher::push_node(size_t height, const uint8_t* digest) {
+    const size_t hash_size = shape_->hash_size;
+    if (pending_.size() <= height) {
+        pending_.resize(height + 1);
+    }
+    pending_[height].insert(pending_[height].end(), digest, digest + hash_size);
+
+    // A full group has its parent already, except under max_height where
+    // one node takes the whole level
+    if (height + 1 != shape_->max_height &&
+        pending_[height].size() == shape_->fan_out * hash_size) {
+        std::array<uint8_t, Threefish3::BLOCK_SIZE> parent;
+        hash_pending(height, parent.data());
+        push_node(height + 1, parent.data());
+    }
+}
+
+void Skein3::StreamingTreeHasher::hash_leaves(size_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+    const size_t hash_size = shape_->hash_size;
+    const size_t count = (bytes + shape_->leaf_size - 1) / shape_->leaf_size;
+    std::vector<uint8_t> leaves(count * hash_size);
+    const uint64_t tag = TreeShape::tag(0);
+    hash_pieces(shape_->chains[0], run_.data(), bytes, shape_->leaf_size,
+                hash_size, leaves.data(), &tag);
+    for (size_t i = 0; i < count; ++i) {
+        push_node(0, leaves.data() + i * hash_size);
+    }
+    run_.erase(run_.begin(), run_.begin() + static_cast<std::ptrdiff_t>(bytes));
+    run_offset_ += bytes;
+}
+
+void Skein3::StreamingTreeHasher::hash_pending(size_t height, uint8_t* parent) {
+    tree_node(tree_chain(shape_->config, height + 1), height + 1,
+              ByteView(pending_[height]), shape_->hash_size, parent);
+    pending_[height].clear();
+}
+
+std::vector<uint8_t> Skein3::StreamingTreeHasher::finalize() {
+    std::vector<uint8_t> result(shape_->hash_size);
+    finalize(result.data());
+    return result;
+}
+
+void Skein3::StreamingTreeHasher::finalize(uint8_t* digest) {
+    // Like tree_hash(), empty input is a single empty leaf
+    if (total_bytes_ == 0) {
+        tree_node(shape_->chains[0], 0, ByteView(), shape_->hash_size, digest);
+        reset();
+        return;
+    }
+    while (!jobs_.empty()) {
+        retire_oldest();
+    }
+
+    // Leaves of the last, partial run
+    const size_t hash_size = shape_->hash_size;
+    hash_leaves(run_.size());
+
+    // Close the right edge bottom-up: every partial group gets its parent
+    // until the top level holds a single node, the root
+    for (size_t height = 0; ; ++height) {
+        if (height + 1 == pending_.size() && pending_[height].size() == hash_size) {
+            break;
+        }
+        if (!pending_[height].empty()) {
+            std::array<uint8_t, Threefish3::BLOCK_SIZE> parent;
+            hash_pending(height, parent.data());
+            push_node(height + 1, parent.data());
+        }
+    }
+
+    std::memcpy(digest, pending_.back().data(), hash_size);
+    reset();
+}
+
+void Skein3::StreamingTreeHasher::save(std::ostream& out) {
+    // Pending runs go into the right edge, and so do the whole leaves of
+    // the current run; only a partial leaf stays as raw data
+    while (!jobs_.empty()) {
+        retire_oldest();
+    }
+    hash_leaves(run_.size() / shape_->leaf_size * shape_->leaf_size);
+
+    const TreeShape& shape = *shape_;
+    StateWriter writer(out, "checkpoint");
+    write_checkpoint_header(writer, CHECKPOINT_TREE, shape.hash_size, shape.chains[0].data());
+    writer.u64(shape.leaf_size);
+    writer.u64(shape.fan_out);
+    writer.u64(shape.max_height);
+    writer.u64(total_bytes_);
+    writer.u64(run_.size());
+    writer.bytes(run_.data(), run_.size());
+    writer.u64(pending_.size());
+    for (const auto& level : pending_) {
+        writer.u64(level.size() / shape.hash_size);
+        writer.bytes(level.data(), level.size());
+    }
+    writer.finish();
+}
+
+void Skein3::StreamingTreeHasher::save(const std::string& filename) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file for writing");
+    }
+    save(file);
+}
+
+Skein3::StreamingTreeHasher Skein3::StreamingTreeHasher::load(std::istream& in,
+                                                              const Config& config) {
+    StreamingTreeHasher hasher(config);
+    const TreeShape& shape = *hasher.shape_;
+    StateReader reader(in, "checkpoint");
+    read_checkpoint_header(reader, CHECKPOINT_TREE, shape.hash_size, shape.chains[0].data());
+    bool same_config = reader.u64() == shape.leaf_size;
+    same_config = reader.u64() == shape.fan_out && same_config;
+    same_config = reader.u64() == shape.max_height && same_config;
+    if (!same_config) {
+        throw std::runtime_error("Checkpoint was saved with a different config");
+    }
+
+    const uint64_t total = reader.u64();
+    const uint64_t tail = reader.u64();
+    if (tail >= shape.leaf_size || tail > total || (total - tail) % shape.leaf_size != 0) {
+        throw std::runtime_error("Inconsistent checkpoint");
+    }
+    reader.bytes(hasher.run_, tail);
+
+    // Every height holds fewer digests than a full group, except the one
+    // under max_height
+    const uint64_t heights = reader.u64();
+    if (heights > shape.max_height) {
+        throw std::runtime_error("Inconsistent checkpoint");
+    }
+    hasher.pending_.resize(static_cast<size_t>(heights));
+    for (size_t height = 0; height < hasher.pending_.size(); ++height) {
+        const uint64_t count = reader.u64();
+        if (height + 1 != shape.max_height && count >= shape.fan_out) {
+            throw std::runtime_error("Inconsistent checkpoint");
+        }
+        reader.bytes(hasher.pending_[height], count * shape.hash_size);
+    }
+    reader.finish();
+
+    // Input continues leaf by leaf up to the next run boundary
+    hasher.total_bytes_ = total;
+    hasher.run_offset_ = static_cast<size_t>((total - tail) % hasher.run_bytes_);
+    hasher.run_.reserve(hasher.run_bytes_);
+    return hasher;
+}
+
+Skein3::StreamingTreeHasher Skein3::StreamingTreeHasher::load(const std::string& filename,
+                                                              const Config& config) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file for reading");
+    }
+    return load(file, config);
+}
+
+// TreeState implementation
+namespace {
+    constexpr char TREE_STATE_MAGIC[8] = {'S', 'K', '3', 'T', 'R', 'E', 'E', 'S'};
+    constexpr uint64_t TREE_STATE_VERSION = 3;
+    constexpr size_t TREE_STATE_FINGERPRINT = 32;
+}
+
+Skein3::TreeState::TreeState(const Config& config)
+    : shape_(config)
+    , size_(0) {
+}
+
+Skein3::TreeState::TreeState(ByteView data, const Config& config)
+    : TreeState(config) {
+    update(data, 0, data.size);
+}
+
+void Skein3::TreeState::update(ByteView data, uint64_t begin, uint64_t end) {
+    if (begin > end || end > data.size) {
+        throw std::invalid_argument("Changed range is outside the data");
+    }
+
+    const uint64_t old_size = size_;
+    const size_t leaf_size = shape_.leaf_size;
+    if (data.size == old_size && begin == end) {
+        return;
+    }
+
+    size_ = data.size;
+    if (size_ == 0) {
+        levels_.clear();
+        return;
+    }
+
+    const size_t num_leaves = static_cast<size_t>((size_ + leaf_size - 1) / leaf_size);
+    size_t first = static_cast<size_t>(begin / leaf_size);
+    size_t last = static_cast<size_t>((end + leaf_size - 1) / leaf_size);
+    if (size_ != old_size) {
+        // A length change also touches the old or new partial last leaf and
+        // the right edge of every level above it
+        first = std::min({first,
+                          static_cast<size_t>(std::min(old_size, size_) / leaf_size),
+                          num_leaves - 1});
+        last = num_leaves;
+    }
+    rehash(data, first, last);
+}
+
+void Skein3::TreeState::rehash(ByteView data, size_t first, size_t last) {
+    const size_t hash_size = shape_.hash_size;
+    const size_t leaf_size = shape_.leaf_size;
+    size_t count = static_cast<size_t>((size_ + leaf_size - 1) / leaf_size);
+    shape_.extend(shape_.root_height(count));
+
+    ThreadPool& pool = ThreadPool::shared();
 
-            Config parent_config = config;
-            parent_config.mode = HashMode::STANDARD;
-            parent_hashes[i] = hash(combined, parent_config);
+    // Değişen leaf'ler doğrudan verinin içinden, parçalar halinde paralel
+    if (levels_.empty()) {
+        levels_.emplace_back();
+    }
+    levels_[0].resize(count * hash_size);
+    const uint64_t tag = TreeShape::tag(0);
+    const size_t leaves_per_task = std::max<size_t>(1, TREE_MIN_TASK_BYTES / leaf_size);
+    pool.parallel_for((last - first + leaves_per_task - 1) / leaves_per_task, [&](size_t t) {
+        const size_t leaf = first + t * leaves_per_task;
+        const size_t offset = leaf * leaf_size;
+        const size_t leaves = std::min(leaves_per_task, last - leaf);
+        hash_pieces(shape_.chains[0], data.data + offset,
+                    std::min(leaves * leaf_size, data.size - offset),
+                    leaf_size, hash_size, levels_[0].data() + leaf * hash_size, &tag);
+    });
+
+    // Her seviyede yalnızca değişen çocukların ebeveynleri
+    size_t height = 0;
+    while (count > 1) {
+        ++height;
+        const size_t group = shape_.group_size(height, count);
+        const size_t parents = (count + group - 1) / group;
+        if (levels_.size() <= height) {
+            levels_.emplace_back();
+        }
+        levels_[height].resize(parents * hash_size);
+
+        first /= group;
+        last = (last + group - 1) / group;
+        const uint8_t* children = levels_[height - 1].data();
+        uint8_t* out = levels_[height].data();
+        const size_t tasks = (last - first + TREE_LEVEL_TASK_NODES - 1) / TREE_LEVEL_TASK_NODES;
+        pool.parallel_for(tasks, [&](size_t t) {
+            const size_t parent = first + t * TREE_LEVEL_TASK_NODES;
+            const size_t nodes = std::min(std::min(TREE_LEVEL_TASK_NODES, last - parent) * group,
+                                          count - parent * group);
+            tree_level(shape_, height, children + parent * group * hash_size,
+                       nodes, out + parent * hash_size);
+        });
+        count = parents;
+    }
+    levels_.resize(height + 1);
+}
+
+std::vector<uint8_t> Skein3::TreeState::root() const {
+    std::vector<uint8_t> result(shape_.hash_size);
+    root(result.data());
+    return result;
+}
+
+void Skein3::TreeState::root(uint8_t* digest) const {
+    if (levels_.empty()) {
+        throw std::invalid_argument("Empty message");
+    }
+    std::memcpy(digest, levels_.back().data(), shape_.hash_size);
+}
+
+void Skein3::TreeState::save(std::ostream& out) const {
+    StateWriter writer(out, "tree state");
+    writer.bytes(TREE_STATE_MAGIC, sizeof(TREE_STATE_MAGIC));
+    writer.u64(TREE_STATE_VERSION);
+    writer.u64(shape_.hash_size);
+    writer.u64(shape_.leaf_size);
+    writer.u64(shape_.fan_out);
+    writer.u64(shape_.max_height);
+    // The leaf chain covers the rest of the config, personalization included
+    writer.bytes(shape_.chains[0].data(), TREE_STATE_FINGERPRINT);
+    writer.u64(size_);
+    for (const auto& level : levels_) {
+        writer.bytes(level.data(), level.size());
+    }
+    writer.finish();
+}
+
+void Skein3::TreeState::save(const std::string& filename) const {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file for writing");
+    }
+    save(file);
+}
+
+Skein3::TreeState Skein3::TreeState::load(std::istream& in, const Config& config) {
+    TreeState state(config);
+    StateReader reader(in, "tree state");
+
+    char magic[sizeof(TREE_STATE_MAGIC)];
+    reader.bytes(magic, sizeof(magic));
+    if (std::memcmp(magic, TREE_STATE_MAGIC, sizeof(magic)) != 0) {
+        throw std::runtime_error("Not a Skein3 tree state");
+    }
+    if (reader.u64() != TREE_STATE_VERSION) {
+        throw std::runtime_error("Unsupported tree state version");
+    }
+
+    const TreeShape& shape = state.shape_;
+    bool same_config = reader.u64() == shape.hash_size;
+    same_config = reader.u64() == shape.leaf_size && same_config;
+    same_config = reader.u64() == shape.fan_out && same_config;
+    same_config = reader.u64() == shape.max_height && same_config;
+    uint8_t fingerprint[TREE_STATE_FINGERPRINT];
+    reader.bytes(fingerprint, sizeof(fingerprint));
+    if (!same_config || std::memcmp(fingerprint, shape.chains[0].data(), sizeof(fingerprint)) != 0) {
+        throw std::runtime_error("Tree state was saved with a different config");
+    }
+
+    state.size_ = reader.u64();
+    size_t count = static_cast<size_t>((state.size_ + shape.leaf_size - 1) / shape.leaf_size);
+    for (size_t height = 0; count > 0; ++height) {
+        state.levels_.emplace_back();
+        reader.bytes(state.levels_.back(), static_cast<uint64_t>(count) * shape.hash_size);
+        if (count == 1) {
+            break;
         }
+        const size_t group = shape.group_size(height + 1, count);
+        count = (count + group - 1) / group;
+    }
+    reader.finish();
+    return state;
+}
 
-        leaf_hashes = std::move(parent_hashes);
+Skein3::TreeState Skein3::TreeState::load(const std::string& filename, const Config& config) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file for reading");
     }
+    return load(file, config);
+}
 
-    return leaf_hashes[0];
+void Skein3::hash_pieces(const std::array<uint64_t, Threefish3::NUM_WORDS>& iv,
+                         const uint8_t* data,
+                         size_t size,
+                         size_t piece,
+                         size_t hash_size,
+                         uint8_t* digests,
+                         const uint64_t* tag) {
+    constexpr size_t GROUP = 64;
+    std::array<const uint8_t*, GROUP> starts;
+    std::array<size_t, GROUP> sizes;
+
+    const size_t count = (size + piece - 1) / piece;
+    for (size_t first = 0; first < count; first += GROUP) {
+        const size_t n = std::min(GROUP, count - first);
+        for (size_t i = 0; i < n; ++i) {
+            const size_t offset = (first + i) * piece;
+            starts[i] = data + offset;
+            sizes[i] = std::min(piece, size - offset);
+        }
+        ubi_many(iv, starts.data(), sizes.data(), n, false, hash_size,
+                 digests + first * hash_size, tag);
+    }
 }
 
 // Helper function for tree hash
@@ -398,17 +1359,7 @@ std::vector<uint8_t> Skein3::process_tree_node(
     bool is_root) {
     
     // Determine security mode
-    Threefish3::SecurityMode sec_mode;
-    switch (config.size) {
-        case HashSize::HASH_1024:
-            sec_mode = Threefish3::SecurityMode::QUANTUM;
-            break;
-        case HashSize::HASH_512:
-            sec_mode = Threefish3::SecurityMode::ENHANCED;
-            break;
-        default:
-            sec_mode = Threefish3::SecurityMode::STANDARD;
-    }
+    const Threefish3::SecurityMode sec_mode = security_mode(config);
 
     // Initialize node context
     BlockContext node_ctx;
@@ -484,20 +1435,215 @@ std::vector<std::vector<uint8_t>> Skein3::batch_hash(
     const std::vector<std::vector<uint8_t>>& messages,
     const Config& config
 ) {
+    return batch_hash(std::vector<ByteView>(messages.begin(), messages.end()), config);
+}
+
+std::vector<std::vector<uint8_t>> Skein3::batch_hash(
+    const std::vector<ByteView>& messages,
+    const Config& config
+) {
+    const size_t hash_size = digest_size(config);
+    std::vector<uint8_t> digests(messages.size() * hash_size);
+    batch_hash(messages, digests.data(), config);
+
     std::vector<std::vector<uint8_t>> results;
     results.reserve(messages.size());
+    for (size_t i = 0; i < messages.size(); ++i) {
+        results.emplace_back(digests.begin() + i * hash_size,
+                             digests.begin() + (i + 1) * hash_size);
+    }
 
+    return results;
+}
+
+void Skein3::batch_hash(const std::vector<ByteView>& messages,
+                        uint8_t* digests,
+                        const Config& config) {
     // Initialize neural network once for batch
     if (config.neural_config.enable_neural_adaptation) {
         initializeNeuralAdapter(config);
     }
 
-    // Process each message
+    if (messages.empty()) {
+        return;
+    }
+
+    // Hash all messages through the multi-buffer engine
+    std::vector<const uint8_t*> data;
+    std::vector<size_t> sizes;
+    data.reserve(messages.size());
+    sizes.reserve(messages.size());
     for (const auto& message : messages) {
-        results.push_back(hash(message, config));
+        data.push_back(message.data);
+        sizes.push_back(message.size);
     }
 
-    return results;
+    hash_many(data.data(), sizes.data(), messages.size(), config, digests);
+}
+
+void Skein3::hash_many(const uint8_t* const* messages,
+                       const size_t* sizes,
+                       size_t count,
+                       const Config& config,
+                       uint8_t* digests) {
+    check_hash_config(config);
+
+    // Every message starts from the same post-config chaining value
+    const auto iv = initial_chain(config);
+    const size_t hash_size = digest_size(config);
+
+    // Consecutive messages are cut into tasks by size, and each task
+    // writes only its own digests, so the output never depends on timing
+    const std::vector<size_t> starts = batch_starts(sizes, count);
+    auto run = [&](size_t t) {
+        const size_t first = starts[t];
+        ubi_many(iv, messages + first, sizes + first, starts[t + 1] - first, false,
+                 hash_size, digests + first * hash_size);
+    };
+    if (starts.size() == 2) {
+        run(0);
+    } else {
+        ThreadPool::shared().parallel_for(starts.size() - 1, run);
+    }
+}
+
+void Skein3::hash_bound(const std::array<uint64_t, Threefish3::NUM_WORDS>& iv,
+                        const uint8_t* const* messages,
+                        const size_t* sizes,
+                        size_t count,
+                        uint64_t tag,
+                        size_t hash_size,
+                        uint8_t* digests) {
+    const std::vector<size_t> starts = batch_starts(sizes, count);
+    auto run = [&](size_t t) {
+        const size_t first = starts[t];
+        ubi_bound(iv, messages + first, sizes + first, starts[t + 1] - first, tag,
+                  hash_size, digests + first * hash_size);
+    };
+    if (starts.size() == 2) {
+        run(0);
+    } else if (starts.size() > 2) {
+        ThreadPool::shared().parallel_for(starts.size() - 1, run);
+    }
+}
+
+void Skein3::ubi_bound(const std::array<uint64_t, Threefish3::NUM_WORDS>& iv,
+                       const uint8_t* const* messages,
+                       const size_t* sizes,
+                       size_t count,
+                       uint64_t tag,
+                       size_t hash_size,
+                       uint8_t* digests) {
+    ubi_many(iv, messages, sizes, count, false, hash_size, digests, &tag);
+}
+
+void Skein3::ubi_many(const std::array<uint64_t, Threefish3::NUM_WORDS>& iv,
+                      const uint8_t* const* messages,
+                      const size_t* sizes,
+                      size_t count,
+                      bool output_transform,
+                      size_t hash_size,
+                      uint8_t* digests,
+                      const uint64_t* tag) {
+    const size_t block_size = Threefish3::BLOCK_SIZE;
+
+    struct Lane {
+        size_t message;
+        size_t offset;
+        bool absorbed;  // every message block has been compressed
+        bool done;
+        std::array<uint64_t, Threefish3::NUM_WORDS> chain;
+        std::array<uint64_t, Threefish3::NUM_WORDS> tail;
+    };
+    std::array<Lane, Threefish3::MAX_LANES> lanes;
+    const size_t max_lanes = Threefish3::multi_buffer_lanes();
+    size_t next = 0;
+
+    // Load the next message into a lane. Without a final block an empty
+    // message has no blocks at all, and its digest is the IV itself.
+    const bool final_block = output_transform || tag != nullptr;
+    auto refill = [&](Lane& lane) {
+        while (next < count) {
+            size_t message = next++;
+            if (sizes[message] == 0 && !final_block) {
+                std::memcpy(digests + message * hash_size, iv.data(), hash_size);
+                continue;
+            }
+            lane.message = message;
+            lane.offset = 0;
+            lane.absorbed = sizes[message] == 0;
+            lane.done = false;
+            lane.chain = iv;
+            return true;
+        }
+        return false;
+    };
+
+    size_t active = 0;
+    while (active < max_lanes && refill(lanes[active])) {
+        active++;
+    }
+
+    std::array<std::array<uint64_t, Threefish3::NUM_WORDS>*, Threefish3::MAX_LANES> chains;
+    std::array<const uint8_t*, Threefish3::MAX_LANES> blocks;
+    while (active > 0) {
+        for (size_t l = 0; l < active; ++l) {
+            Lane& lane = lanes[l];
+            chains[l] = &lane.chain;
+
+            if (lane.absorbed) {
+                if (tag != nullptr) {
+                    // The short last block was zero padded, so the trailer
+                    // is what tells every message length apart
+                    lane.tail.fill(0);
+                    uint8_t* trailer = reinterpret_cast<uint8_t*>(lane.tail.data());
+                    for (size_t i = 0; i < 8; ++i) {
+                        trailer[i] = static_cast<uint8_t>(*tag >> (8 * i));
+                        trailer[8 + i] = static_cast<uint8_t>(
+                            uint64_t(sizes[lane.message]) >> (8 * i));
+                    }
+                    blocks[l] = trailer;
+                } else {
+                    blocks[l] = reinterpret_cast<const uint8_t*>(ZERO_BLOCK.data());
+                }
+                lane.done = true;
+                continue;
+            }
+
+            const uint8_t* data = messages[lane.message] + lane.offset;
+            size_t remaining = sizes[lane.message] - lane.offset;
+
+            // Full blocks are read in place; a short final block is padded
+            if (remaining >= block_size) {
+                blocks[l] = data;
+                lane.offset += block_size;
+            } else {
+                lane.tail.fill(0);
+                std::memcpy(lane.tail.data(), data, remaining);
+                blocks[l] = reinterpret_cast<const uint8_t*>(lane.tail.data());
+                lane.offset += remaining;
+            }
+            lane.absorbed = lane.offset == sizes[lane.message];
+            lane.done = lane.absorbed && !final_block;
+        }
+
+        Threefish3::ubi_multi(chains.data(), blocks.data(), active);
+
+        // Retire finished messages and keep the active lanes contiguous
+        for (size_t l = 0; l < active;) {
+            Lane& lane = lanes[l];
+            if (!lane.done) {
+                ++l;
+                continue;
+            }
+            std::memcpy(digests + lane.message * hash_size, lane.chain.data(), hash_size);
+            if (refill(lane)) {
+                ++l;
+            } else {
+                std::swap(lane, lanes[--active]);
+            }
+        }
+    }
 }
 
 void Skein3::saveNeuralWeights(const std::string& filename) {
@@ -561,8 +1707,14 @@ void Skein3::secureCleanup() {
 bool Skein3::verifyHash(const std::vector<uint8_t>& message,
                        const std::vector<uint8_t>& hash,
                        const Config& config) {
-    auto computed_hash = Skein3::hash(message, config);
-    return computed_hash == hash;
+    return verifyHash(ByteView(message), ByteView(hash), config);
+}
+
+bool Skein3::verifyHash(ByteView message, ByteView hash, const Config& config) {
+    std::array<uint8_t, static_cast<size_t>(HashSize::HASH_1024) / 8> computed;
+    Skein3::hash(message, computed.data(), config);
+    return digest_size(config) == hash.size &&
+           std::equal(hash.data, hash.data + hash.size, computed.begin());
 }
 
 std::vector<uint8_t> Skein3::checkpoint_data_;
@@ -572,37 +1724,66 @@ std::vector<uint8_t> Skein3::merkle_root(
     const std::vector<std::vector<uint8_t>>& transactions,
     const Config& config
 ) {
+    return merkle_root(std::vector<ByteView>(transactions.begin(), transactions.end()), config);
+}
+
+std::vector<uint8_t> Skein3::merkle_root(
+    const std::vector<ByteView>& transactions,
+    const Config& config
+) {
+    std::vector<uint8_t> root(digest_size(config));
+    merkle_root(transactions, root.data(), config);
+    return root;
+}
+
+void Skein3::merkle_root(const std::vector<ByteView>& transactions,
+                         uint8_t* root,
+                         const Config& config) {
     if (transactions.empty()) {
         throw std::invalid_argument("Empty transaction list");
     }
 
-    std::vector<std::vector<uint8_t>> current_level;
-    for (const auto& tx : transactions) {
-        current_level.push_back(hash(tx, config));
-    }
-
-    while (current_level.size() > 1) {
-        std::vector<std::vector<uint8_t>> next_level;
-        
-        for (size_t i = 0; i < current_level.size(); i += 2) {
-            std::vector<uint8_t> combined;
-            combined.insert(combined.end(), 
-                          current_level[i].begin(), 
-                          current_level[i].end());
-
-            if (i + 1 < current_level.size()) {
-                combined.insert(combined.end(),
-                              current_level[i + 1].begin(),
-                              current_level[i + 1].end());
-            }
+    AlignedDigests leaves = allocate_digests(transactions.size() * digest_size(config));
+    batch_hash(transactions, leaves.get(), config);
+    merkle_root_from_digests(leaves.get(), transactions.size(), root, config);
+}
 
-            next_level.push_back(hash(combined, config));
-        }
+void Skein3::merkle_root_from_digests(const uint8_t* leaves, size_t count, uint8_t* root,
+                                      const Config& config) {
+    if (count == 0) {
+        throw std::invalid_argument("Empty transaction list");
+    }
+    check_hash_config(config);
+    const size_t hash_size = digest_size(config);
+    if (count == 1) {
+        std::memcpy(root, leaves, hash_size);
+        return;
+    }
 
-        current_level = std::move(next_level);
+    // Levels are flat digest buffers, so a pair of siblings is already one
+    // contiguous message: each level is hash_pieces() over pairs, cut into
+    // fixed runs of parents that the pool hashes in any order
+    const auto iv = initial_chain(config);
+    const size_t pair = 2 * hash_size;
+    AlignedDigests level = allocate_digests((count + 1) / 2 * hash_size);
+    AlignedDigests parents = allocate_digests((count + 3) / 4 * hash_size);
+    const uint8_t* children = leaves;
+    ThreadPool& pool = ThreadPool::shared();
+    while (count > 1) {
+        const size_t num_parents = (count + 1) / 2;
+        const size_t tasks = (num_parents + MERKLE_TASK_NODES - 1) / MERKLE_TASK_NODES;
+        uint8_t* out = children == level.get() ? parents.get() : level.get();
+        pool.parallel_for(tasks, [&](size_t t) {
+            const size_t first = t * MERKLE_TASK_NODES;
+            const size_t nodes = std::min(2 * MERKLE_TASK_NODES, count - 2 * first);
+            hash_pieces(iv, children + first * pair, nodes * hash_size, pair, hash_size,
+                        out + first * hash_size);
+        });
+        children = out;
+        count = num_parents;
     }
 
-    return current_level[0];
+    std::memcpy(root, children, hash_size);
 }
 
 void Skein3::process_block(
@@ -611,14 +1792,14 @@ void Skein3::process_block(
     size_t size,
     Threefish3::SecurityMode sec_mode
 ) {
+    // Full blocks are encrypted straight from the caller's buffer; only a
+    // short final block is copied out to be zero padded
+    const uint8_t* input = data;
     std::array<uint64_t, Threefish3::NUM_WORDS> block;
-    
-    // Blok verilerini kopyala ve sıfırla
-    if (size == Threefish3::BLOCK_SIZE) {
-        std::memcpy(block.data(), data, size);
-    } else {
+    if (size != Threefish3::BLOCK_SIZE) {
         std::memset(block.data(), 0, Threefish3::BLOCK_SIZE);
         std::memcpy(block.data(), data, size);
+        input = reinterpret_cast<const uint8_t*>(block.data());
     }
     
     // Tweak değerlerini güncelle
@@ -629,13 +1810,9 @@ void Skein3::process_block(
                    (ctx.domain << 56);
     ctx.tweak[2] = 0;  // Reserved for future use
     
-    // Threefish şifreleme
-    Threefish3 cipher(ctx.state, ctx.tweak, sec_mode);
-    std::array<uint64_t, Threefish3::NUM_WORDS> cipher_text;
-    cipher.encrypt(block, cipher_text);
-    
-    // State'i güncelle
-    for (size_t i = 0; i < Threefish3::NUM_WORDS; ++i) {
-        ctx.state[i] = block[i] ^ cipher_text[i];
-    }
+    // Threefish şifreleme: rekey from the chaining value and feed forward.
+    // The security mode only ever altered the cipher's unused state copy,
+    // so the keyed context does not need it.
+    (void)sec_mode;
+    ctx.cipher.ubi(ctx.state, input);
 }
@@ -0,0 +1,359 @@
+#include "skein3.h"
+#include "thread_pool.h"
+#include "state_io.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#define SKEIN3_POSIX_FILES 1
+#endif
+
+// Directory snapshots: list the tree level by level, stat and hash the
+// files on the pool, and reuse digests whose stat data is unchanged
+
+namespace {
+    constexpr char SNAPSHOT_MAGIC[8] = {'S', 'K', '3', 'I', 'N', 'D', 'E', 'X'};
+    constexpr uint64_t SNAPSHOT_VERSION = 3;
+    constexpr size_t SNAPSHOT_FINGERPRINT = 32;
+
+    // A file whose mtime is this close to the previous scan may have been
+    // written again within the same timestamp tick, so it is re-hashed.
+    // Two seconds covers the coarsest common granularity (FAT).
+    constexpr int64_t RACY_WINDOW_NS = 2000000000;
+
+    int64_t wall_clock_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    struct Listing {
+        std::vector<std::string> files;
+        std::vector<std::string> directories;
+        std::string error;
+    };
+
+    std::string join_path(const std::string& base, const std::string& relative) {
+        return relative.empty() ? base : base + "/" + relative;
+    }
+
+    // Names of one directory, without following symbolic links. A
+    // directory that cannot be read leaves its error in the listing.
+    void list_directory(const std::string& base, const std::string& relative, Listing& listing) {
+        std::error_code error;
+        std::filesystem::directory_iterator item(join_path(base, relative), error);
+        for (; !error && item != std::filesystem::directory_iterator(); item.increment(error)) {
+            std::string name = item->path().filename().string();
+            std::string path = relative.empty() ? name : relative + "/" + name;
+            const auto type = item->symlink_status().type();
+            if (type == std::filesystem::file_type::directory) {
+                listing.directories.push_back(std::move(path));
+            } else if (type == std::filesystem::file_type::regular) {
+                listing.files.push_back(std::move(path));
+            }
+        }
+        if (error) {
+            listing.error = error.message();
+        }
+    }
+
+#ifdef SKEIN3_POSIX_FILES
+    int64_t timespec_ns(const struct timespec& time) {
+        return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+    }
+#endif
+
+    // False if the file is gone or is no longer a regular file
+    bool stat_file(const std::string& path, Skein3::DirectorySnapshot::Entry& entry) {
+#ifdef SKEIN3_POSIX_FILES
+        struct stat info;
+        if (::lstat(path.c_str(), &info) != 0) {
+            if (errno == ENOENT || errno == ENOTDIR) {
+                return false;
+            }
+            throw std::runtime_error(path + ": " + std::strerror(errno));
+        }
+        if (!S_ISREG(info.st_mode)) {
+            return false;
+        }
+        entry.size = static_cast<uint64_t>(info.st_size);
+        entry.inode = static_cast<uint64_t>(info.st_ino);
+#if defined(__APPLE__)
+        entry.mtime_ns = timespec_ns(info.st_mtimespec);
+        entry.ctime_ns = timespec_ns(info.st_ctimespec);
+#else
+        entry.mtime_ns = timespec_ns(info.st_mtim);
+        entry.ctime_ns = timespec_ns(info.st_ctim);
+#endif
+        return true;
+#else
+        std::error_code error;
+        const auto status = std::filesystem::symlink_status(path, error);
+        if (error || status.type() != std::filesystem::file_type::regular) {
+            return false;
+        }
+        entry.size = static_cast<uint64_t>(std::filesystem::file_size(path));
+        entry.mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::filesystem::last_write_time(path).time_since_epoch()).count();
+        entry.ctime_ns = 0;
+        entry.inode = 0;
+        return true;
+#endif
+    }
+
+    bool same_stat(const Skein3::DirectorySnapshot::Entry& a,
+                   const Skein3::DirectorySnapshot::Entry& b) {
+        return a.size == b.size && a.mtime_ns == b.mtime_ns &&
+               a.ctime_ns == b.ctime_ns && a.inode == b.inode;
+    }
+
+    void put_u64(std::vector<uint8_t>& out, uint64_t value) {
+        for (size_t i = 0; i < 8; ++i) {
+            out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+}
+
+Skein3::DirectorySnapshot::DirectorySnapshot(const Config& config)
+    : config_(config)
+    , hash_size_(digest_size(config))
+    , scan_time_ns_(0)
+    , files_hashed_(0) {
+    if (config.mode == HashMode::TREE) {
+        fingerprint_ = TreeShape(config).chains[0];
+    } else {
+        check_hash_config(config);
+        fingerprint_ = initial_chain(config);
+    }
+}
+
+void Skein3::DirectorySnapshot::scan(const std::string& directory) {
+    ThreadPool& pool = ThreadPool::shared();
+    const int64_t scan_time = wall_clock_ns();
+
+    // The directories of each level are listed in parallel
+    std::vector<std::string> paths;
+    std::vector<Failure> failures;
+    std::vector<std::string> frontier(1);
+    while (!frontier.empty()) {
+        std::vector<Listing> listings(frontier.size());
+        pool.parallel_for(frontier.size(), [&](size_t i) {
+            list_directory(directory, frontier[i], listings[i]);
+        });
+        for (size_t i = 0; i < frontier.size(); ++i) {
+            if (!listings[i].error.empty()) {
+                if (frontier[i].empty()) {
+                    throw std::runtime_error(directory + ": " + listings[i].error);
+                }
+                failures.push_back({std::move(frontier[i]), std::move(listings[i].error)});
+            }
+        }
+        frontier.clear();
+        for (auto& listing : listings) {
+            paths.insert(paths.end(), std::make_move_iterator(listing.files.begin()),
+                         std::make_move_iterator(listing.files.end()));
+            frontier.insert(frontier.end(), std::make_move_iterator(listing.directories.begin()),
+                            std::make_move_iterator(listing.directories.end()));
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    // Both lists are sorted, so one merge pass finds each file's old entry
+    const size_t count = paths.size();
+    std::vector<size_t> previous(count, SIZE_MAX);
+    for (size_t i = 0, j = 0; i < count && j < entries_.size();) {
+        const int order = paths[i].compare(entries_[j].path);
+        if (order == 0) {
+            previous[i++] = j++;
+        } else if (order < 0) {
+            ++i;
+        } else {
+            ++j;
+        }
+    }
+
+    std::vector<Entry> entries(count);
+    std::vector<uint8_t> digests(count * hash_size_);
+    std::vector<char> present(count, 0);
+    std::vector<std::string> errors(count);
+    std::atomic<size_t> hashed{0};
+    pool.parallel_for(count, [&](size_t i) {
+        Entry& entry = entries[i];
+        entry.path = std::move(paths[i]);
+        const std::string full_path = join_path(directory, entry.path);
+        try {
+            if (!stat_file(full_path, entry)) {
+                return;
+            }
+
+            // Stat before hashing: a write during hashing changes the stat
+            // data, so the next scan hashes the file again
+            const size_t old = previous[i];
+            if (old != SIZE_MAX && same_stat(entry, entries_[old]) &&
+                entry.mtime_ns < scan_time_ns_ - RACY_WINDOW_NS) {
+                std::memcpy(digests.data() + i * hash_size_, digest(old), hash_size_);
+            } else {
+                hash_file(full_path, digests.data() + i * hash_size_, config_);
+                hashed.fetch_add(1, std::memory_order_relaxed);
+            }
+            present[i] = 1;
+        } catch (const std::exception& error) {
+            errors[i] = error.what();
+        }
+    });
+
+    // Files removed since they were listed are dropped, and files that
+    // could not be read move to the failures
+    size_t kept = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!errors[i].empty()) {
+            failures.push_back({entries[i].path, std::move(errors[i])});
+        }
+        if (present[i]) {
+            if (kept != i) {
+                entries[kept] = std::move(entries[i]);
+                std::memcpy(digests.data() + kept * hash_size_,
+                            digests.data() + i * hash_size_, hash_size_);
+            }
+            ++kept;
+        }
+    }
+    entries.resize(kept);
+    digests.resize(kept * hash_size_);
+
+    std::sort(failures.begin(), failures.end(),
+              [](const Failure& a, const Failure& b) { return a.path < b.path; });
+
+    entries_ = std::move(entries);
+    digests_ = std::move(digests);
+    failures_ = std::move(failures);
+    scan_time_ns_ = scan_time;
+    files_hashed_ = hashed.load();
+}
+
+std::vector<uint8_t> Skein3::DirectorySnapshot::root() const {
+    std::vector<uint8_t> result(hash_size_);
+    root(result.data());
+    return result;
+}
+
+void Skein3::DirectorySnapshot::root(uint8_t* digest) const {
+    // The root is a MerkleTree whatever mode the files were hashed in
+    Config root_config = config_;
+    root_config.mode = HashMode::STANDARD;
+    if (entries_.empty()) {
+        hash(ByteView(), digest, root_config);
+        return;
+    }
+
+    std::vector<size_t> offsets;
+    std::vector<uint8_t> leaves;
+    offsets.reserve(entries_.size() + 1);
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        const Entry& entry = entries_[i];
+        offsets.push_back(leaves.size());
+        put_u64(leaves, entry.path.size());
+        leaves.insert(leaves.end(), entry.path.begin(), entry.path.end());
+        put_u64(leaves, entry.size);
+        leaves.insert(leaves.end(), this->digest(i), this->digest(i) + hash_size_);
+    }
+    offsets.push_back(leaves.size());
+
+    std::vector<ByteView> views(entries_.size());
+    for (size_t i = 0; i < views.size(); ++i) {
+        views[i] = ByteView(leaves.data() + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    MerkleTree(views, root_config).root(digest);
+}
+
+void Skein3::DirectorySnapshot::save(std::ostream& out) const {
+    StateWriter writer(out, "snapshot index");
+    writer.bytes(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    writer.u64(SNAPSHOT_VERSION);
+    writer.u64(hash_size_);
+    writer.bytes(fingerprint_.data(), SNAPSHOT_FINGERPRINT);
+    writer.u64(static_cast<uint64_t>(scan_time_ns_));
+    writer.u64(entries_.size());
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        const Entry& entry = entries_[i];
+        writer.u64(entry.path.size());
+        writer.bytes(entry.path.data(), entry.path.size());
+        writer.u64(entry.size);
+        writer.u64(static_cast<uint64_t>(entry.mtime_ns));
+        writer.u64(static_cast<uint64_t>(entry.ctime_ns));
+        writer.u64(entry.inode);
+        writer.bytes(digest(i), hash_size_);
+    }
+    writer.finish();
+}
+
+void Skein3::DirectorySnapshot::save(const std::string& filename) const {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file for writing");
+    }
+    save(file);
+}
+
+Skein3::DirectorySnapshot Skein3::DirectorySnapshot::load(std::istream& in, const Config& config) {
+    DirectorySnapshot snapshot(config);
+    StateReader reader(in, "snapshot index");
+
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    reader.bytes(magic, sizeof(magic));
+    if (std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0) {
+        throw std::runtime_error("Not a Skein3 snapshot index");
+    }
+    if (reader.u64() != SNAPSHOT_VERSION) {
+        throw std::runtime_error("Unsupported snapshot index version");
+    }
+
+    const size_t hash_size = snapshot.hash_size_;
+    bool same_config = reader.u64() == hash_size;
+    uint8_t fingerprint[SNAPSHOT_FINGERPRINT];
+    reader.bytes(fingerprint, sizeof(fingerprint));
+    if (!same_config ||
+        std::memcmp(fingerprint, snapshot.fingerprint_.data(), sizeof(fingerprint)) != 0) {
+        throw std::runtime_error("Snapshot index was saved with a different config");
+    }
+
+    snapshot.scan_time_ns_ = static_cast<int64_t>(reader.u64());
+    const uint64_t count = reader.u64();
+    std::vector<uint8_t> path;
+    for (uint64_t i = 0; i < count; ++i) {
+        Entry entry;
+        reader.bytes(path, reader.u64());
+        entry.path.assign(path.begin(), path.end());
+        entry.size = reader.u64();
+        entry.mtime_ns = static_cast<int64_t>(reader.u64());
+        entry.ctime_ns = static_cast<int64_t>(reader.u64());
+        entry.inode = reader.u64();
+        if (!snapshot.entries_.empty() && !(snapshot.entries_.back().path < entry.path)) {
+            throw std::runtime_error("Snapshot index entries are not sorted");
+        }
+        snapshot.entries_.push_back(std::move(entry));
+
+        const size_t offset = snapshot.digests_.size();
+        snapshot.digests_.resize(offset + hash_size);
+        reader.bytes(snapshot.digests_.data() + offset, hash_size);
+    }
+    reader.finish();
+    return snapshot;
+}
+
+Skein3::DirectorySnapshot Skein3::DirectorySnapshot::load(const std::string& filename,
+                                                          const Config& config) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file for reading");
+    }
+    return load(file, config);
+}
@@ -33,4 +33,8 @@ ThreadPool::~ThreadPool() {
     for (std::thread& worker : workers_) {
         worker.join();
     }
-} 
\ No newline at end of file
+} 
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
@@ -1,11 +1,12 @@
 #include "threefish3.h"
-
-#include <immintrin.h>
+#include "threefish3_kernels.h"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <future>
 #include <iostream>
@@ -14,6 +15,12 @@
 #include <vector>
 #include <numeric>
 #include <random>
+#include <stdexcept>
+#include <string>
+
+#if defined(SKEIN3_X86_KERNELS) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 // Custom hash function
 struct ByteVectorHash {
@@ -26,6 +33,207 @@ struct ByteVectorHash {
     }
 };
 
+namespace {
+    const Threefish3Kernels* compiled_kernels(Threefish3::Backend backend) {
+        switch (backend) {
+            case Threefish3::Backend::SCALAR:
+                return &threefish3_scalar_kernels;
+#ifdef SKEIN3_X86_KERNELS
+            case Threefish3::Backend::AVX2:
+                return &threefish3_avx2_kernels;
+            case Threefish3::Backend::AVX512:
+                return &threefish3_avx512_kernels;
+#endif
+            default:
+                return nullptr;
+        }
+    }
+
+    bool cpu_supports(Threefish3::Backend backend) {
+        if (backend == Threefish3::Backend::SCALAR) {
+            return true;
+        }
+#if defined(SKEIN3_X86_KERNELS) && (defined(__GNUC__) || defined(__clang__))
+        // Also checks that the OS saves the wider register state
+        __builtin_cpu_init();
+        if (backend == Threefish3::Backend::AVX2) {
+            return __builtin_cpu_supports("avx2");
+        }
+        return __builtin_cpu_supports("avx512f");
+#elif defined(SKEIN3_X86_KERNELS) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (!osxsave) {
+            return false;
+        }
+        const unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+        if (backend == Threefish3::Backend::AVX2) {
+            return (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+        }
+        return (xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16)) != 0;
+#else
+        return false;
+#endif
+    }
+
+    Threefish3::Backend detect_backend() {
+        // Explicit override, mainly for testing the slower backends
+        if (const char* forced = std::getenv("SKEIN3_BACKEND")) {
+            for (auto backend : {Threefish3::Backend::SCALAR,
+                                 Threefish3::Backend::AVX2,
+                                 Threefish3::Backend::AVX512}) {
+                if (std::strcmp(forced, Threefish3::backend_name(backend)) == 0 &&
+                    Threefish3::backend_supported(backend)) {
+                    return backend;
+                }
+            }
+        }
+
+        if (Threefish3::backend_supported(Threefish3::Backend::AVX512)) {
+            return Threefish3::Backend::AVX512;
+        }
+        if (Threefish3::backend_supported(Threefish3::Backend::AVX2)) {
+            return Threefish3::Backend::AVX2;
+        }
+        return Threefish3::Backend::SCALAR;
+    }
+
+    std::atomic<const Threefish3Kernels*>& active_kernels() {
+        static std::atomic<const Threefish3Kernels*> active(
+            compiled_kernels(detect_backend()));
+        return active;
+    }
+}
+
+bool Threefish3::backend_supported(Backend backend) {
+    return compiled_kernels(backend) != nullptr && cpu_supports(backend);
+}
+
+Threefish3::Backend Threefish3::active_backend() {
+    const Threefish3Kernels* active = active_kernels().load(std::memory_order_acquire);
+    for (auto backend : {Backend::SCALAR, Backend::AVX2, Backend::AVX512}) {
+        if (compiled_kernels(backend) == active) {
+            return backend;
+        }
+    }
+    return Backend::SCALAR;
+}
+
+const char* Threefish3::backend_name(Backend backend) {
+    switch (backend) {
+        case Backend::AVX2:
+            return "avx2";
+        case Backend::AVX512:
+            return "avx512";
+        default:
+            return "scalar";
+    }
+}
+
+void Threefish3::set_backend(Backend backend) {
+    if (!backend_supported(backend)) {
+        throw std::invalid_argument(std::string("Threefish3 backend not supported: ") +
+                                    backend_name(backend));
+    }
+    active_kernels().store(compiled_kernels(backend), std::memory_order_release);
+}
+
+const Threefish3Kernels& Threefish3::kernels() {
+    return *active_kernels().load(std::memory_order_acquire);
+}
+
+Threefish3::Context::Context() {
+    key_schedule_.fill(0);
+}
+
+Threefish3::Context::Context(const std::array<uint64_t, NUM_WORDS>& key)
+    : key_schedule_(key) {}
+
+void Threefish3::Context::rekey(const std::array<uint64_t, NUM_WORDS>& key) {
+    key_schedule_ = key;
+}
+
+void Threefish3::Context::encrypt(const std::array<uint64_t, NUM_WORDS>& plaintext,
+                                  std::array<uint64_t, NUM_WORDS>& ciphertext) const {
+    kernels().encrypt(key_schedule_.data(),
+                      reinterpret_cast<const uint8_t*>(plaintext.data()),
+                      ciphertext.data(), false);
+}
+
+void Threefish3::Context::ubi(std::array<uint64_t, NUM_WORDS>& chain,
+                              const uint8_t* block) {
+    // The chaining value becomes the key; after that it is free to be
+    // overwritten by the ciphertext directly
+    rekey(chain);
+    kernels().encrypt(key_schedule_.data(), block, chain.data(), true);
+}
+
+void Threefish3::ubi_block(const std::array<uint64_t, NUM_WORDS>& chain,
+                           const uint8_t* block,
+                           std::array<uint64_t, NUM_WORDS>& out) {
+    kernels().encrypt(chain.data(), block, out.data(), true);
+}
+
+size_t Threefish3::multi_buffer_lanes() {
+    return kernels().lanes;
+}
+
+void Threefish3::ubi_multi(std::array<uint64_t, NUM_WORDS>* const* chains,
+                           const uint8_t* const* blocks,
+                           size_t count) {
+    const Threefish3Kernels& active = kernels();
+    if (active.ubi_sliced == nullptr) {
+        for (size_t i = 0; i < count; i++) {
+            active.encrypt(chains[i]->data(), blocks[i], chains[i]->data(), true);
+        }
+        return;
+    }
+
+    const size_t lanes = active.lanes;
+    alignas(64) uint64_t chain_words[NUM_WORDS * MAX_LANES];
+    alignas(64) uint64_t block_words[NUM_WORDS * MAX_LANES];
+
+    // Transpose up to `lanes` chains into sliced form, run one pass and
+    // transpose back. Unused lanes repeat the group's first chain.
+    auto run_group = [&](size_t first, size_t group) {
+        for (size_t l = 0; l < lanes; l++) {
+            size_t src = first + (l < group ? l : 0);
+            const uint64_t* chain = chains[src]->data();
+            for (size_t w = 0; w < NUM_WORDS; w++) {
+                chain_words[w * lanes + l] = chain[w];
+                std::memcpy(&block_words[w * lanes + l], blocks[src] + w * 8, 8);
+            }
+        }
+
+        active.ubi_sliced(chain_words, block_words);
+
+        for (size_t l = 0; l < group; l++) {
+            uint64_t* chain = chains[first + l]->data();
+            for (size_t w = 0; w < NUM_WORDS; w++) {
+                chain[w] = chain_words[w * lanes + l];
+            }
+        }
+    };
+
+    size_t i = 0;
+    for (; i + lanes <= count; i += lanes) {
+        run_group(i, lanes);
+    }
+
+    // A mostly empty pass costs more than running the stragglers one at a
+    // time through the single-chain kernel
+    size_t remaining = count - i;
+    if (remaining > 0 && remaining >= lanes / 2) {
+        run_group(i, remaining);
+    } else {
+        for (; i < count; i++) {
+            active.encrypt(chains[i]->data(), blocks[i], chains[i]->data(), true);
+        }
+    }
+}
+
 Threefish3::~Threefish3() = default;
 
 Threefish3::Threefish3(const std::array<uint64_t, NUM_WORDS>& state,
@@ -58,95 +266,13 @@ void Threefish3::permute_words(std::array<uint64_t, NUM_WORDS>& data) {
 
 void Threefish3::encrypt(const std::array<uint64_t, NUM_WORDS>& plaintext,
                          std::array<uint64_t, NUM_WORDS>& ciphertext) {
-    // Convert to SIMD data structures
-    std::array<__m256i, NUM_WORDS / 4> simd_data;
-    for (size_t i = 0; i < NUM_WORDS / 4; i++) {
-        simd_data[i] = _mm256_loadu_si256(
-            reinterpret_cast<const __m256i*>(&plaintext[i * 4]));
-    }
-
-    // Key schedule initialization
-    std::array<__m256i, (NUM_WORDS + 1) / 4> extended_key;
-    for (size_t i = 0; i < NUM_WORDS / 4; i++) {
-        extended_key[i] = _mm256_loadu_si256(
-            reinterpret_cast<const __m256i*>(&key_[i * 4]));
-    }
-
-    // Main encryption loop with SIMD
-    for (size_t d = 0; d < NUM_ROUNDS / MIX_ROUNDS; d++) {
-        // Add round key using SIMD
-        for (size_t i = 0; i < NUM_WORDS / 4; i++) {
-            simd_data[i] = _mm256_add_epi64(
-                simd_data[i], extended_key[(d + i) % ((NUM_WORDS + 1) / 4)]);
-        }
-
-        // Mix function using SIMD
-        for (size_t j = 0; j < MIX_ROUNDS; j++) {
-            for (size_t i = 0; i < NUM_WORDS / 4; i++) {
-                simd_mix_function(simd_data[i], d * MIX_ROUNDS + j);
-            }
-            simd_permute_words(simd_data);
-        }
-    }
-
-    // Convert SIMD data back to normal array
-    for (size_t i = 0; i < NUM_WORDS / 4; i++) {
-        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&ciphertext[i * 4]),
-                            simd_data[i]);
-    }
+    kernels().encrypt(key_.data(), reinterpret_cast<const uint8_t*>(plaintext.data()),
+                      ciphertext.data(), false);
 }
 
 void Threefish3::decrypt(const std::array<uint64_t, NUM_WORDS>& ciphertext,
                          std::array<uint64_t, NUM_WORDS>& plaintext) {
-    // Convert to SIMD data structures
-    std::array<__m256i, NUM_WORDS / 4> simd_data;
-    for (size_t i = 0; i < NUM_WORDS / 4; i++) {
-        simd_data[i] = _mm256_loadu_si256(
-            reinterpret_cast<const __m256i*>(&ciphertext[i * 4]));
-    }
-
-    // Key schedule initialization
-    std::array<__m256i, (NUM_WORDS + 1) / 4> extended_key;
-    for (size_t i = 0; i < NUM_WORDS / 4; i++) {
-        extended_key[i] = _mm256_loadu_si256(
-            reinterpret_cast<const __m256i*>(&key_[i * 4]));
-    }
-
-    // Reverse encryption loop
-    for (int d = NUM_ROUNDS / MIX_ROUNDS - 1; d >= 0; d--) {
-        // Inverse mix function
-        for (int j = MIX_ROUNDS - 1; j >= 0; j--) {
-            // Inverse permutation
-            std::array<__m256i, NUM_WORDS / 4> temp = simd_data;
-            for (size_t i = 0; i < NUM_WORDS / 4; i++) {
-                simd_data[i] =
-                    temp[(i + (NUM_WORDS / 4 - 1)) % (NUM_WORDS / 4)];
-            }
-
-            // Inverse mix operation
-            for (size_t i = 0; i < NUM_WORDS / 4; i++) {
-                simd_inverse_mix_function(simd_data[i], d * MIX_ROUNDS + j);
-            }
-        }
-
-        // Subtract round key
-        for (size_t i = 0; i < NUM_WORDS / 4; i++) {
-            simd_data[i] = _mm256_sub_epi64(
-                simd_data[i], extended_key[(d + i) % ((NUM_WORDS + 1) / 4)]);
-        }
-
-        // Subtract tweak (for first block)
-        if (d % (NUM_WORDS / 4) == 0) {
-            __m256i tweak_vector = _mm256_set_epi64x(0, 0, 0, tweak_[d % 3]);
-            simd_data[0] = _mm256_sub_epi64(simd_data[0], tweak_vector);
-        }
-    }
-
-    // Convert SIMD data back to normal array
-    for (size_t i = 0; i < NUM_WORDS / 4; i++) {
-        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&plaintext[i * 4]),
-                            simd_data[i]);
-    }
+    kernels().decrypt(key_.data(), tweak_.data(), ciphertext.data(), plaintext.data());
 }
 
 void Threefish3::inverse_mix_function(uint64_t& x0, uint64_t& x1, int round) {
@@ -156,47 +282,6 @@ void Threefish3::inverse_mix_function(uint64_t& x0, uint64_t& x1, int round) {
     x0 -= x1;
 }
 
-void Threefish3::simd_mix_function(__m256i& block, int round) {
-    // 4 pairs of 64-bit numbers at the same time
-    __m256i temp = block;
-    int rotation = round % 7 + 45;
-
-    // Add x0 += x1 operation for 4 pairs at the same time
-    __m256i added =
-        _mm256_add_epi64(block, _mm256_permute4x64_epi64(block, 0xB1));
-
-    // Rotate and XOR operations for 4 pairs at the same time
-    __m256i rotated = _mm256_or_si256(
-        _mm256_slli_epi64(_mm256_permute4x64_epi64(block, 0xB1), rotation),
-        _mm256_srli_epi64(_mm256_permute4x64_epi64(block, 0xB1),
-                          64 - rotation));
-
-    block = _mm256_xor_si256(added, rotated);
-}
-
-void Threefish3::simd_permute_words(std::array<__m256i, NUM_WORDS / 4>& data) {
-    std::array<__m256i, NUM_WORDS / 4> temp = data;
-    for (size_t i = 0; i < NUM_WORDS / 4; i++) {
-        data[i] = temp[(i + 1) % (NUM_WORDS / 4)];
-    }
-}
-
-void Threefish3::simd_inverse_mix_function(__m256i& block, int round) {
-    int rotation = round % 7 + 45;
-
-    // Inverse XOR operation
-    __m256i temp = block;
-
-    // Inverse rotation
-    __m256i rotated = _mm256_or_si256(
-        _mm256_srli_epi64(_mm256_permute4x64_epi64(temp, 0xB1), rotation),
-        _mm256_slli_epi64(_mm256_permute4x64_epi64(temp, 0xB1), 64 - rotation));
-
-    // Inverse addition operation
-    block = _mm256_sub_epi64(_mm256_xor_si256(temp, rotated),
-                             _mm256_permute4x64_epi64(rotated, 0xB1));
-}
-
 void Threefish3::encrypt_chunk(const uint8_t* input, uint8_t* output,
                                size_t start_block, size_t num_blocks) {
     std::array<uint64_t, NUM_WORDS> block, result;
@@ -0,0 +1,164 @@
+#include "threefish3_kernels.h"
+
+#include <immintrin.h>
+
+// AVX-512 backend: one block as four 512-bit registers (two groups each),
+// eight lanes when sliced. Compiled with -mavx512f and only reached after
+// a cpuid check.
+
+namespace {
+    constexpr size_t N = Threefish3::NUM_WORDS;
+    constexpr size_t REGS = N / 8;
+
+    // The helpers below use the masked intrinsics with an all-ones mask.
+    // That is the same instruction, but it avoids the _mm512_undefined_*
+    // placeholder that GCC 12 reports as uninitialized at every use.
+
+    // Swap the two words of every pair
+    inline __m512i swap_pairs(__m512i v) {
+        return _mm512_mask_shuffle_epi32(v, 0xFFFF, v, _MM_PERM_BADC);
+    }
+
+    template <int R>
+    inline __m512i rotl(__m512i v) {
+        return _mm512_mask_rol_epi64(v, 0xFF, v, R);
+    }
+
+    // Words 4..7 of low followed by words 0..3 of high
+    inline __m512i join_groups(__m512i high, __m512i low) {
+        return _mm512_mask_alignr_epi64(low, 0xFF, high, low, 4);
+    }
+
+    // Registers holding groups (2k + 1, 2k + 2): the block rotated by one group
+    inline void rotate_group_down(__m512i (&z)[REGS]) {
+        __m512i first = z[0];
+        for (size_t k = 0; k + 1 < REGS; k++) {
+            z[k] = join_groups(z[k + 1], z[k]);
+        }
+        z[REGS - 1] = join_groups(first, z[REGS - 1]);
+    }
+
+    inline void rotate_group_up(__m512i (&z)[REGS]) {
+        __m512i last = z[REGS - 1];
+        for (size_t k = REGS - 1; k > 0; k--) {
+            z[k] = join_groups(z[k], z[k - 1]);
+        }
+        z[0] = join_groups(z[0], last);
+    }
+
+    // Key registers for even rounds (groups 2k, 2k + 1) and odd rounds
+    // (groups 2k + 1, 2k + 2), so every round key is a register rename
+    inline void load_key(const uint64_t* key, __m512i (&even)[REGS], __m512i (&odd)[REGS]) {
+        for (size_t k = 0; k < REGS; k++) {
+            even[k] = _mm512_loadu_si512(key + k * 8);
+            odd[k] = even[k];
+        }
+        rotate_group_down(odd);
+    }
+
+    inline __m512i round_key(const __m512i (&even)[REGS], const __m512i (&odd)[REGS],
+                             size_t d, size_t k) {
+        return (d % 2 == 0) ? even[(k + d / 2) % REGS] : odd[(k + d / 2) % REGS];
+    }
+
+    THREEFISH3_FLATTEN void avx512_encrypt(const uint64_t* key, const uint8_t* plaintext,
+                        uint64_t* ciphertext, bool feed_forward) {
+        __m512i z[REGS];
+        for (size_t k = 0; k < REGS; k++) {
+            z[k] = _mm512_loadu_si512(plaintext + k * 64);
+        }
+
+        __m512i even[REGS];
+        __m512i odd[REGS];
+        load_key(key, even, odd);
+
+        // 72 rounds of straight-line code; see Threefish3Round for why the
+        // groups never move
+        threefish3_unroll<Threefish3::NUM_ROUNDS>([&](auto round) {
+            using Schedule = Threefish3Round<decltype(round)::value>;
+            if constexpr (Schedule::INJECTS_KEY) {
+                threefish3_unroll<REGS>([&](auto k) {
+                    z[k.value] = _mm512_add_epi64(
+                        z[k.value], round_key(even, odd, Schedule::KEY_ROUND, k.value));
+                });
+            }
+            threefish3_unroll<REGS>([&](auto k) {
+                __m512i swapped = swap_pairs(z[k.value]);
+                z[k.value] = _mm512_xor_si512(_mm512_add_epi64(z[k.value], swapped),
+                                              rotl<Schedule::ROTATION>(swapped));
+            });
+        });
+
+        for (size_t k = 0; k < REGS; k++) {
+            __m512i out = z[k];
+            if (feed_forward) {
+                out = _mm512_xor_si512(out, _mm512_loadu_si512(plaintext + k * 64));
+            }
+            _mm512_storeu_si512(ciphertext + k * 8, out);
+        }
+    }
+
+    void avx512_decrypt(const uint64_t* key, const uint64_t* tweak,
+                        const uint64_t* ciphertext, uint64_t* plaintext) {
+        __m512i z[REGS];
+        for (size_t k = 0; k < REGS; k++) {
+            z[k] = _mm512_loadu_si512(ciphertext + k * 8);
+        }
+
+        __m512i even[REGS];
+        __m512i odd[REGS];
+        load_key(key, even, odd);
+
+        for (int d = Threefish3::NUM_ROUNDS / Threefish3::MIX_ROUNDS - 1; d >= 0; d--) {
+            for (int j = Threefish3::MIX_ROUNDS - 1; j >= 0; j--) {
+                rotate_group_up(z);
+
+                __m512i rotation = _mm512_set1_epi64((d * Threefish3::MIX_ROUNDS + j) % 7 + 45);
+                for (size_t k = 0; k < REGS; k++) {
+                    __m512i swapped = swap_pairs(z[k]);
+                    __m512i rotated = _mm512_mask_rorv_epi64(swapped, 0xFF, swapped, rotation);
+                    z[k] = _mm512_sub_epi64(_mm512_xor_si512(z[k], rotated),
+                                            swap_pairs(rotated));
+                }
+            }
+
+            for (size_t k = 0; k < REGS; k++) {
+                z[k] = _mm512_sub_epi64(z[k], round_key(even, odd, d, k));
+            }
+
+            // Subtract tweak (for first block)
+            if (d % (N / 4) == 0) {
+                z[0] = _mm512_sub_epi64(z[0], _mm512_maskz_set1_epi64(1, tweak[d % 3]));
+            }
+        }
+
+        for (size_t k = 0; k < REGS; k++) {
+            _mm512_storeu_si512(plaintext + k * 8, z[k]);
+        }
+    }
+
+    // Word-sliced lane operations: vector w holds word w of eight chains
+    struct Avx512Lanes {
+        using Vector = __m512i;
+        static constexpr size_t LANES = 8;
+
+        static Vector load(const uint64_t* p) { return _mm512_load_si512(p); }
+        static void store(uint64_t* p, Vector v) { _mm512_store_si512(p, v); }
+        static Vector add(Vector a, Vector b) { return _mm512_add_epi64(a, b); }
+        static Vector bit_xor(Vector a, Vector b) { return _mm512_xor_si512(a, b); }
+        template <int R>
+        static Vector rotl(Vector v) { return ::rotl<R>(v); }
+    };
+
+    THREEFISH3_FLATTEN void avx512_ubi_sliced(uint64_t* chain, const uint64_t* block) {
+        threefish3_sliced_rounds<Avx512Lanes, true>(chain, block, chain);
+    }
+}
+
+const Threefish3Kernels threefish3_avx512_kernels = {
+    "avx512",
+    Avx512Lanes::LANES,
+    avx512_encrypt,
+    avx512_decrypt,
+    avx512_ubi_sliced
+};
@@ -0,0 +1,88 @@
+#include "threefish3_kernels.h"
+
+#include <cstring>
+
+// Portable backend: plain 64-bit arithmetic, runs on any CPU
+
+namespace {
+    constexpr size_t N = Threefish3::NUM_WORDS;
+
+    struct ScalarLanes {
+        using Vector = uint64_t;
+        static constexpr size_t LANES = 1;
+
+        static Vector load(const uint64_t* p) { return *p; }
+        static void store(uint64_t* p, Vector v) { *p = v; }
+        static Vector add(Vector a, Vector b) { return a + b; }
+        static Vector bit_xor(Vector a, Vector b) { return a ^ b; }
+        template <int R>
+        static Vector rotl(Vector v) { return (v << R) | (v >> (64 - R)); }
+    };
+
+    inline uint64_t rotr(uint64_t v, int r) {
+        return (v >> r) | (v << (64 - r));
+    }
+
+    THREEFISH3_FLATTEN void scalar_encrypt(const uint64_t* key, const uint8_t* plaintext,
+                        uint64_t* ciphertext, bool feed_forward) {
+        uint64_t block[N];
+        std::memcpy(block, plaintext, sizeof(block));
+        if (feed_forward) {
+            threefish3_sliced_rounds<ScalarLanes, true>(key, block, ciphertext);
+        } else {
+            threefish3_sliced_rounds<ScalarLanes, false>(key, block, ciphertext);
+        }
+    }
+
+    void scalar_decrypt(const uint64_t* key, const uint64_t* tweak,
+                        const uint64_t* ciphertext, uint64_t* plaintext) {
+        uint64_t x[N];
+        std::memcpy(x, ciphertext, sizeof(x));
+
+        for (int d = Threefish3::NUM_ROUNDS / Threefish3::MIX_ROUNDS - 1; d >= 0; d--) {
+            for (int j = Threefish3::MIX_ROUNDS - 1; j >= 0; j--) {
+                // Inverse permutation: every group of four words moves up one
+                uint64_t temp[N];
+                std::memcpy(temp, x, sizeof(x));
+                for (size_t w = 0; w < N; w++) {
+                    x[w] = temp[(w + N - 4) % N];
+                }
+
+                // Inverse mix operation
+                int rotation = (d * Threefish3::MIX_ROUNDS + j) % 7 + 45;
+                for (size_t p = 0; p < N; p += 2) {
+                    uint64_t r0 = rotr(x[p + 1], rotation);
+                    uint64_t r1 = rotr(x[p], rotation);
+                    uint64_t x0 = (x[p] ^ r0) - r1;
+                    uint64_t x1 = (x[p + 1] ^ r1) - r0;
+                    x[p] = x0;
+                    x[p + 1] = x1;
+                }
+            }
+
+            // Subtract round key
+            for (size_t w = 0; w < N; w++) {
+                x[w] -= key[(w + 4 * d) % N];
+            }
+
+            // Subtract tweak (for first block)
+            if (d % (N / 4) == 0) {
+                x[0] -= tweak[d % 3];
+            }
+        }
+
+        std::memcpy(plaintext, x, sizeof(x));
+    }
+
+    THREEFISH3_FLATTEN void scalar_ubi_sliced(uint64_t* chain, const uint64_t* block) {
+        threefish3_sliced_rounds<ScalarLanes, true>(chain, block, chain);
+    }
+}
+
+const Threefish3Kernels threefish3_scalar_kernels = {
+    "scalar",
+    ScalarLanes::LANES,
+    scalar_encrypt,
+    scalar_decrypt,
+    scalar_ubi_sliced
+};